@@ -0,0 +1,196 @@
+#include "adaptive_execution.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <execution>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+atomic<size_t> in_flight_calls{0};
+atomic<uint64_t> sequential_calls{0};
+atomic<uint64_t> parallel_calls{0};
+atomic<uint64_t> batched_calls{0};
+
+atomic<const AdaptiveCostModel*> current_model{nullptr};
+once_flag calibration_flag;
+mutex models_mutex;
+// Replaced models stay allocated: callers may still hold references to them
+deque<AdaptiveCostModel> models;
+
+const int CALIBRATION_DOCUMENT_COUNT = 2000;
+const int CALIBRATION_REPEAT_COUNT = 9;
+const int RARE_WORD_COUNT = 100;
+const int SMALL_DOCUMENT_WORDS = 4;
+const int LARGE_DOCUMENT_WORDS = 400;
+
+template <typename Run>
+double MeasureMedianNs(Run&& run) {
+    using Clock = chrono::steady_clock;
+    run(0);
+    vector<double> times;
+    for (int i = 1; i <= CALIBRATION_REPEAT_COUNT; ++i) {
+        const auto start = Clock::now();
+        run(i);
+        times.push_back(chrono::duration<double, nano>(Clock::now() - start).count());
+    }
+    nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+// Line through two measurements; per-item cost is kept positive so that speedups stay finite
+ExecutionCost FitCost(size_t light_items, double light_ns, size_t heavy_items, double heavy_ns) {
+    ExecutionCost cost;
+    cost.per_item_ns = max((heavy_ns - light_ns) / (heavy_items - light_items), 1e-3);
+    cost.fixed_ns = max(light_ns - cost.per_item_ns * light_items, 0.0);
+    return cost;
+}
+
+AdaptiveCostModel Calibrate() {
+    AdaptiveCostModel model;
+    model.core_count = max(1u, thread::hardware_concurrency());
+    if (model.core_count <= 1) {
+        // Every call runs sequentially on a single core, so there is nothing to compare
+        return model;
+    }
+    // The calibration queries are not part of the workload
+    SEARCH_STATS_SUSPEND();
+
+    // Every document has the four common words and one of RARE_WORD_COUNT rare words
+    SearchServer search_server(""s);
+    for (int id = 0; id < CALIBRATION_DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, "common0 common1 common2 common3 rare"s + to_string(id % RARE_WORD_COUNT),
+                                  DocumentStatus::ACTUAL, {1});
+    }
+    const string light_query = "rare0"s;
+    const string heavy_query = "common0 common1 common2 common3"s;
+    const size_t light_postings = CALIBRATION_DOCUMENT_COUNT / RARE_WORD_COUNT;
+    const size_t heavy_postings = 4 * CALIBRATION_DOCUMENT_COUNT;
+    model.search_seq = FitCost(
+        light_postings, MeasureMedianNs([&](int) { search_server.FindTopDocuments(execution::seq, light_query); }),
+        heavy_postings, MeasureMedianNs([&](int) { search_server.FindTopDocuments(execution::seq, heavy_query); }));
+    model.search_par = FitCost(
+        light_postings, MeasureMedianNs([&](int) { search_server.FindTopDocuments(execution::par, light_query); }),
+        heavy_postings, MeasureMedianNs([&](int) { search_server.FindTopDocuments(execution::par, heavy_query); }));
+
+    string small_document;
+    for (int i = 0; i < SMALL_DOCUMENT_WORDS; ++i) {
+        small_document += "small"s + to_string(i) + ' ';
+    }
+    string large_document;
+    for (int i = 0; i < LARGE_DOCUMENT_WORDS; ++i) {
+        large_document += "large"s + to_string(i) + ' ';
+    }
+    // Fresh documents for every removal, added after the searches are measured
+    int next_id = CALIBRATION_DOCUMENT_COUNT;
+    const auto add_documents = [&](const string& text) {
+        const int first_id = next_id;
+        for (int i = 0; i <= CALIBRATION_REPEAT_COUNT; ++i) {
+            search_server.AddDocument(next_id++, text, DocumentStatus::ACTUAL, {1});
+        }
+        return first_id;
+    };
+    const auto measure_remove = [&](const auto& policy, const string& text) {
+        const int first_id = add_documents(text);
+        return MeasureMedianNs([&](int i) { search_server.RemoveDocument(policy, first_id + i); });
+    };
+    model.remove_seq = FitCost(SMALL_DOCUMENT_WORDS, measure_remove(execution::seq, small_document),
+                               LARGE_DOCUMENT_WORDS, measure_remove(execution::seq, large_document));
+    model.remove_par = FitCost(SMALL_DOCUMENT_WORDS, measure_remove(execution::par, small_document),
+                               LARGE_DOCUMENT_WORDS, measure_remove(execution::par, large_document));
+    return model;
+}
+
+} // namespace
+
+double ExecutionCost::Estimate(size_t work_items) const {
+    return fixed_ns + per_item_ns * work_items;
+}
+
+const AdaptiveCostModel& GetAdaptiveCostModel() {
+    if (const AdaptiveCostModel* model = current_model.load(memory_order_acquire)) {
+        return *model;
+    }
+    call_once(calibration_flag, [] {
+        AdaptiveCostModel model = Calibrate();
+        lock_guard guard(models_mutex);
+        // SetAdaptiveCostModel may have run during the calibration
+        if (current_model.load(memory_order_relaxed) == nullptr) {
+            current_model.store(&models.emplace_back(model), memory_order_release);
+        }
+    });
+    return *current_model.load(memory_order_acquire);
+}
+
+void SetAdaptiveCostModel(const AdaptiveCostModel& model) {
+    lock_guard guard(models_mutex);
+    current_model.store(&models.emplace_back(model), memory_order_release);
+}
+
+ExecutionPath SelectExecutionPath(AdaptiveOperation operation, size_t work_items, size_t in_flight) {
+    const AdaptiveCostModel& model = GetAdaptiveCostModel();
+    const size_t busy_cores = in_flight > 0 ? in_flight - 1 : 0;
+    if (model.core_count <= 1 || busy_cores >= model.core_count) {
+        return ExecutionPath::SEQUENTIAL;
+    }
+    const size_t free_cores = model.core_count - busy_cores;
+    if (operation == AdaptiveOperation::BATCH) {
+        // Enough queries to occupy every free core; otherwise heavy queries are better split
+        return work_items >= free_cores ? ExecutionPath::BATCHED : ExecutionPath::SEQUENTIAL;
+    }
+    const bool is_search = operation == AdaptiveOperation::SEARCH;
+    const ExecutionCost& seq = is_search ? model.search_seq : model.remove_seq;
+    const ExecutionCost& par = is_search ? model.search_par : model.remove_par;
+    // The speedup was measured on idle cores and shrinks with the share of them still free
+    const double speedup = max(1.0, seq.per_item_ns / par.per_item_ns * free_cores / model.core_count);
+    const double par_estimate = par.fixed_ns + seq.per_item_ns / speedup * work_items;
+    return par_estimate < seq.Estimate(work_items) ? ExecutionPath::PARALLEL : ExecutionPath::SEQUENTIAL;
+}
+
+void RecordExecutionPath(ExecutionPath path, size_t calls) {
+    switch (path) {
+    case ExecutionPath::SEQUENTIAL:
+        sequential_calls.fetch_add(calls, memory_order_relaxed);
+        break;
+    case ExecutionPath::PARALLEL:
+        parallel_calls.fetch_add(calls, memory_order_relaxed);
+        break;
+    case ExecutionPath::BATCHED:
+        batched_calls.fetch_add(calls, memory_order_relaxed);
+        break;
+    }
+}
+
+AdaptiveExecutionStats GetAdaptiveExecutionStats() {
+    AdaptiveExecutionStats stats;
+    stats.sequential = sequential_calls.load(memory_order_relaxed);
+    stats.parallel = parallel_calls.load(memory_order_relaxed);
+    stats.batched = batched_calls.load(memory_order_relaxed);
+    return stats;
+}
+
+void ResetAdaptiveExecutionStats() {
+    sequential_calls.store(0, memory_order_relaxed);
+    parallel_calls.store(0, memory_order_relaxed);
+    batched_calls.store(0, memory_order_relaxed);
+}
+
+AdaptiveLoadGuard::AdaptiveLoadGuard()
+    : in_flight_(in_flight_calls.fetch_add(1, memory_order_relaxed) + 1) {
+}
+
+AdaptiveLoadGuard::~AdaptiveLoadGuard() {
+    in_flight_calls.fetch_sub(1, memory_order_relaxed);
+}
+
+size_t AdaptiveLoadGuard::GetInFlight() const {
+    return in_flight_;
+}
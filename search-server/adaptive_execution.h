@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Policy tag for SearchServer and ProcessQueries overloads that choose the execution
+// path per call: search_server.FindTopDocuments(adaptive_policy, query)
+struct AdaptivePolicy {};
+inline constexpr AdaptivePolicy adaptive_policy{};
+
+enum class ExecutionPath {
+    SEQUENTIAL,
+    // Intra-query parallelism: one call split between threads
+    PARALLEL,
+    // Inter-query parallelism: a batch of calls, each run sequentially
+    BATCHED,
+};
+
+enum class AdaptiveOperation {
+    // Work items are the postings of the query terms
+    SEARCH,
+    // Work items are the words of the removed document
+    REMOVE,
+    // Work items are the queries of the batch
+    BATCH,
+};
+
+// Estimated call time, fixed_ns + per_item_ns * work_items, on otherwise idle cores
+struct ExecutionCost {
+    double fixed_ns = 0.0;
+    double per_item_ns = 0.0;
+
+    double Estimate(size_t work_items) const;
+};
+
+struct AdaptiveCostModel {
+    ExecutionCost search_seq;
+    ExecutionCost search_par;
+    ExecutionCost remove_seq;
+    ExecutionCost remove_par;
+    size_t core_count = 1;
+};
+
+struct AdaptiveExecutionStats {
+    uint64_t sequential = 0;
+    uint64_t parallel = 0;
+    uint64_t batched = 0;
+};
+
+// Calibrated on first use by a micro-benchmark of the seq and par paths on a small
+// synthetic index (tens of milliseconds, skipped on a single core, kept out of the
+// search stats); call at startup to keep it off the first query
+const AdaptiveCostModel& GetAdaptiveCostModel();
+// Replaces the calibrated model, e.g. with one measured on production data
+void SetAdaptiveCostModel(const AdaptiveCostModel& model);
+
+// Chooses the path for a call with work_items of the given operation. The parallel
+// speedup is discounted by the share of cores already busy with other adaptive calls.
+// For BATCH the result is BATCHED or SEQUENTIAL, the latter meaning the queries run
+// one after another, each choosing its own path.
+ExecutionPath SelectExecutionPath(AdaptiveOperation operation, size_t work_items, size_t in_flight);
+
+// Counters of the paths that actually ran; a batch counts each of its queries
+void RecordExecutionPath(ExecutionPath path, size_t calls = 1);
+AdaptiveExecutionStats GetAdaptiveExecutionStats();
+void ResetAdaptiveExecutionStats();
+
+// Marks an adaptive call as running for its lifetime; the count is process-wide
+class AdaptiveLoadGuard {
+public:
+    AdaptiveLoadGuard();
+    ~AdaptiveLoadGuard();
+    AdaptiveLoadGuard(const AdaptiveLoadGuard&) = delete;
+    AdaptiveLoadGuard& operator=(const AdaptiveLoadGuard&) = delete;
+
+    // Adaptive calls running now, including this one
+    size_t GetInFlight() const;
+
+private:
+    size_t in_flight_;
+};
@@ -0,0 +1,439 @@
+#include "search_server.h"
+#include "process_queries.h"
+#include "query_generators.h"
+#include "corpus_loader.h"
+#include "near_duplicates.h"
+#include "segmented_index.h"
+#include "text_analysis.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Reproducible benchmark: prints one JSON document with latency percentiles
+// and throughput for every (corpus size, operation, thread count), and the
+// process peak RSS once at the end. --threads sweeps only the client threads
+// of find_top_documents_concurrent; the other rows are called from one thread.
+// Usage: benchmark [--sizes=1000,10000] [--threads=1,2,4] [--queries=1000]
+//                  [--minus-prob=0.1] [--zipf=1.0] [--seed=42] [--batches=10]
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct BenchmarkConfig {
+    vector<int> corpus_sizes = {1'000, 10'000, 50'000};
+    vector<int> thread_counts = {1, 2, 4, 8};
+    int query_count = 1'000;
+    int dictionary_size = 20'000;
+    int min_document_length = 5;
+    int max_document_length = 300;
+    int max_query_length = 8;
+    int batch_repeat_count = 10;
+    double minus_prob = 0.1;
+    double zipf_exponent = 1.0;
+    unsigned seed = 42;
+};
+
+struct Measurement {
+    int corpus_size;
+    string operation;
+    int threads;
+    vector<double> latencies_us;
+    double seconds;
+    double megabytes = 0.0;
+    // Queries per timed call for batch operations: latencies and throughput are per batch
+    int batch_size = 1;
+    // Operations of a row timed only as a whole: it reports throughput and no percentiles
+    size_t untimed_count = 0;
+};
+
+class ZipfSampler {
+public:
+    ZipfSampler(size_t size, double exponent) {
+        cumulative_.reserve(size);
+        double sum = 0;
+        for (size_t rank = 1; rank <= size; ++rank) {
+            sum += 1.0 / pow(static_cast<double>(rank), exponent);
+            cumulative_.push_back(sum);
+        }
+        for (double& value : cumulative_) {
+            value /= sum;
+        }
+    }
+
+    size_t operator()(mt19937& generator) const {
+        const double point = uniform_real_distribution<>(0, 1)(generator);
+        const auto it = lower_bound(cumulative_.begin(), cumulative_.end(), point);
+        return min<size_t>(it - cumulative_.begin(), cumulative_.size() - 1);
+    }
+
+private:
+    vector<double> cumulative_;
+};
+
+vector<int> ParseIntList(string_view text) {
+    vector<int> values;
+    while (!text.empty()) {
+        const size_t comma = min(text.find(','), text.size());
+        values.push_back(stoi(string(text.substr(0, comma))));
+        text.remove_prefix(min(comma + 1, text.size()));
+    }
+    return values;
+}
+
+BenchmarkConfig ParseArguments(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view argument = argv[i];
+        const size_t equals = argument.find('=');
+        const string_view key = argument.substr(0, equals);
+        const string value = equals == string_view::npos ? ""s : string(argument.substr(equals + 1));
+        if (key == "--sizes"sv) {
+            config.corpus_sizes = ParseIntList(value);
+        } else if (key == "--threads"sv) {
+            config.thread_counts = ParseIntList(value);
+        } else if (key == "--queries"sv) {
+            config.query_count = stoi(value);
+        } else if (key == "--minus-prob"sv) {
+            config.minus_prob = stod(value);
+        } else if (key == "--zipf"sv) {
+            config.zipf_exponent = stod(value);
+        } else if (key == "--seed"sv) {
+            config.seed = static_cast<unsigned>(stoul(value));
+        } else if (key == "--batches"sv) {
+            config.batch_repeat_count = stoi(value);
+        } else {
+            throw invalid_argument("Unknown argument "s + string(argument));
+        }
+    }
+    return config;
+}
+
+vector<string> GenerateZipfDocuments(mt19937& generator, const vector<string>& dictionary,
+                                     const ZipfSampler& sampler, const BenchmarkConfig& config, int count) {
+    vector<string> documents;
+    documents.reserve(count);
+    // Log-normal lengths give the long tail of real documents
+    lognormal_distribution<> length_distribution(log(40.0), 0.8);
+    for (int i = 0; i < count; ++i) {
+        const int length = clamp(static_cast<int>(length_distribution(generator)),
+                                 config.min_document_length, config.max_document_length);
+        string document;
+        for (int j = 0; j < length; ++j) {
+            if (!document.empty()) {
+                document.push_back(' ');
+            }
+            document += dictionary[sampler(generator)];
+        }
+        documents.push_back(move(document));
+    }
+    return documents;
+}
+
+vector<string> GenerateMixedQueries(mt19937& generator, const vector<string>& dictionary,
+                                    const BenchmarkConfig& config) {
+    vector<string> queries;
+    queries.reserve(config.query_count);
+    for (int i = 0; i < config.query_count; ++i) {
+        const int word_count = uniform_int_distribution(1, config.max_query_length)(generator);
+        queries.push_back(GenerateQuery(generator, dictionary, word_count, config.minus_prob));
+    }
+    return queries;
+}
+
+// One rare word with two of the most frequent non-stop words: the union of their
+// postings is most of the corpus, the intersection a handful of documents
+vector<string> GenerateRareTermQueries(mt19937& generator, const vector<string>& dictionary,
+                                       const BenchmarkConfig& config) {
+    const size_t common_word_count = 8;
+    uniform_int_distribution<size_t> rare_word(dictionary.size() / 10, dictionary.size() - 1);
+    uniform_int_distribution<size_t> common_word(3, 3 + common_word_count - 1);
+    vector<string> queries;
+    queries.reserve(config.query_count);
+    for (int i = 0; i < config.query_count; ++i) {
+        queries.push_back(dictionary[rare_word(generator)] + ' ' + dictionary[common_word(generator)] + ' '
+                          + dictionary[common_word(generator)]);
+    }
+    return queries;
+}
+
+template <typename Operation>
+Measurement Measure(int corpus_size, string operation, int count, Operation&& run) {
+    Measurement measurement{corpus_size, move(operation), 1, {}, 0};
+    measurement.latencies_us.reserve(count);
+    const auto start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        const auto operation_start = Clock::now();
+        run(i);
+        measurement.latencies_us.push_back(chrono::duration<double, micro>(Clock::now() - operation_start).count());
+    }
+    measurement.seconds = chrono::duration<double>(Clock::now() - start).count();
+    return measurement;
+}
+
+Measurement MeasureConcurrentSearch(int corpus_size, const SearchServer& search_server,
+                                    const vector<string>& queries, int thread_count) {
+    Measurement measurement{corpus_size, "find_top_documents_concurrent"s, thread_count, {}, 0};
+    vector<vector<double>> thread_latencies(thread_count);
+    atomic<size_t> next_query{0};
+    const auto start = Clock::now();
+    {
+        vector<thread> workers;
+        for (int t = 0; t < thread_count; ++t) {
+            workers.emplace_back([&, t] {
+                for (size_t i; (i = next_query.fetch_add(1)) < queries.size();) {
+                    const auto operation_start = Clock::now();
+                    search_server.FindTopDocuments(queries[i]);
+                    thread_latencies[t].push_back(
+                        chrono::duration<double, micro>(Clock::now() - operation_start).count());
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    measurement.seconds = chrono::duration<double>(Clock::now() - start).count();
+    for (const auto& latencies : thread_latencies) {
+        measurement.latencies_us.insert(measurement.latencies_us.end(), latencies.begin(), latencies.end());
+    }
+    return measurement;
+}
+
+Measurement MeasureCorpusLoad(int corpus_size, const vector<string>& documents, const vector<string>& stop_words) {
+    char path[] = "/tmp/search_server_corpusXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        throw runtime_error("Cannot create a temporary corpus file"s);
+    }
+    close(fd);
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            out << i << "\tACTUAL\t1,2,3\t"s << documents[i] << '\n';
+        }
+    }
+    SearchServer search_server(stop_words);
+    const CorpusLoadStats stats = LoadCorpus(search_server, path);
+    unlink(path);
+
+    Measurement measurement{corpus_size, "load_corpus"s, static_cast<int>(thread::hardware_concurrency()), {}, 0};
+    // Documents are parsed and added in parallel chunks, so only the whole load is timed
+    measurement.untimed_count = stats.documents;
+    measurement.seconds = stats.seconds;
+    measurement.megabytes = stats.bytes / (1024.0 * 1024.0);
+    return measurement;
+}
+
+// Text analysis throughput over the whole corpus, reported in documents and megabytes
+template <typename Analyze>
+Measurement MeasureTextAnalysis(int corpus_size, string operation, const vector<string>& documents, Analyze&& analyze) {
+    auto measurement = Measure(corpus_size, move(operation), static_cast<int>(documents.size()), [&](int i) {
+        analyze(documents[i]);
+    });
+    for (const string& document : documents) {
+        measurement.megabytes += document.size() / (1024.0 * 1024.0);
+    }
+    return measurement;
+}
+
+long GetPeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double Percentile(const vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+void PrintMeasurement(ostream& out, Measurement& measurement) {
+    auto& latencies = measurement.latencies_us;
+    sort(latencies.begin(), latencies.end());
+    const size_t count = latencies.empty() ? measurement.untimed_count : latencies.size();
+    out << "{\"corpus_size\": "s << measurement.corpus_size
+        << ", \"operation\": \""s << measurement.operation << '"'
+        << ", \"threads\": "s << measurement.threads
+        << ", \"count\": "s << count;
+    if (measurement.batch_size > 1) {
+        out << ", \"batch_size\": "s << measurement.batch_size;
+    }
+    if (!latencies.empty()) {
+        out << ", \"p50_us\": "s << Percentile(latencies, 0.5)
+            << ", \"p99_us\": "s << Percentile(latencies, 0.99)
+            << ", \"p999_us\": "s << Percentile(latencies, 0.999);
+    }
+    out << ", \"throughput_ops\": "s << (measurement.seconds > 0 ? count / measurement.seconds : 0.0);
+    if (measurement.megabytes > 0) {
+        out << ", \"throughput_mb_s\": "s << (measurement.seconds > 0 ? measurement.megabytes / measurement.seconds : 0.0);
+    }
+    out << '}';
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const BenchmarkConfig config = ParseArguments(argc, argv);
+    mt19937 generator(config.seed);
+    const auto dictionary = GenerateDictionary(generator, config.dictionary_size, 12);
+    const ZipfSampler sampler(dictionary.size(), config.zipf_exponent);
+    // Calibrated up front so that it is not charged to the first adaptive query
+    GetAdaptiveCostModel();
+
+    ostringstream results;
+    bool first = true;
+    auto report = [&](Measurement measurement) {
+        results << (first ? "\n    "s : ",\n    "s);
+        PrintMeasurement(results, measurement);
+        first = false;
+    };
+
+    for (const int corpus_size : config.corpus_sizes) {
+        const auto documents = GenerateZipfDocuments(generator, dictionary, sampler, config, corpus_size);
+        const auto queries = GenerateMixedQueries(generator, dictionary, config);
+        const int query_count = static_cast<int>(queries.size());
+
+        // The most frequent words are used as stop words, as a real deployment would
+        const vector<string> stop_words(dictionary.begin(), dictionary.begin() + 3);
+        report(MeasureCorpusLoad(corpus_size, documents, stop_words));
+        {
+            AnalyzedText terms;
+            report(MeasureTextAnalysis(corpus_size, "split_into_words"s, documents, [&](const string& document) {
+                SplitIntoWords(document);
+            }));
+            const AnalyzerChain<WhitespaceTokenizer> whitespace_analyzer;
+            report(MeasureTextAnalysis(corpus_size, "analyze_whitespace"s, documents, [&](const string& document) {
+                terms.Clear();
+                whitespace_analyzer.Analyze(document, terms);
+            }));
+            const MultilingualAnalyzer multilingual_analyzer;
+            report(MeasureTextAnalysis(corpus_size, "analyze_multilingual"s, documents, [&](const string& document) {
+                terms.Clear();
+                multilingual_analyzer.Analyze(document, terms);
+            }));
+            SearchServer analyzed_server(stop_words, make_shared<MultilingualAnalyzer>());
+            report(Measure(corpus_size, "add_document_multilingual"s, corpus_size, [&](int i) {
+                analyzed_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }));
+        }
+        SearchServer search_server(stop_words);
+        report(Measure(corpus_size, "add_document"s, corpus_size, [&](int i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }));
+        report(Measure(corpus_size, "find_top_documents_seq"s, query_count, [&](int i) {
+            search_server.FindTopDocuments(execution::seq, queries[i]);
+        }));
+        report(Measure(corpus_size, "find_top_documents_par"s, query_count, [&](int i) {
+            search_server.FindTopDocuments(execution::par, queries[i]);
+        }));
+        report(Measure(corpus_size, "find_top_documents_auto"s, query_count, [&](int i) {
+            search_server.FindTopDocuments(adaptive_policy, queries[i]);
+        }));
+        {
+            // Own generator, so the other workloads do not depend on this one
+            mt19937 rare_term_generator(config.seed);
+            const auto rare_term_queries = GenerateRareTermQueries(rare_term_generator, dictionary, config);
+            report(Measure(corpus_size, "find_top_documents_rare_any"s, query_count, [&](int i) {
+                search_server.FindTopDocuments(rare_term_queries[i]);
+            }));
+            report(Measure(corpus_size, "find_top_documents_rare_all"s, query_count, [&](int i) {
+                search_server.FindTopDocumentsAllTerms(rare_term_queries[i]);
+            }));
+        }
+        report(Measure(corpus_size, "match_document_seq"s, query_count, [&](int i) {
+            search_server.MatchDocument(execution::seq, queries[i], i % corpus_size);
+        }));
+        report(Measure(corpus_size, "match_document_par"s, query_count, [&](int i) {
+            search_server.MatchDocument(execution::par, queries[i], i % corpus_size);
+        }));
+        {
+            // Highlighting-style batch: one query against the first hundred documents
+            vector<int> document_ids(min(corpus_size, 100));
+            iota(document_ids.begin(), document_ids.end(), 0);
+            report(Measure(corpus_size, "match_documents_par"s, query_count, [&](int i) {
+                search_server.MatchDocuments(execution::par, queries[i], document_ids);
+            }));
+        }
+        for (const int thread_count : config.thread_counts) {
+            report(MeasureConcurrentSearch(corpus_size, search_server, queries, thread_count));
+        }
+        {
+            auto measurement = Measure(corpus_size, "process_queries"s, config.batch_repeat_count, [&](int) {
+                ProcessQueries(search_server, queries);
+            });
+            measurement.batch_size = query_count;
+            measurement.threads = static_cast<int>(thread::hardware_concurrency());
+            report(move(measurement));
+        }
+        {
+            // One pass over the whole index: throughput in documents, no percentiles
+            auto measurement = Measure(corpus_size, "find_near_duplicate_groups"s, 1, [&](int) {
+                FindNearDuplicateGroups(search_server);
+            });
+            measurement.latencies_us.clear();
+            measurement.untimed_count = corpus_size;
+            measurement.threads = static_cast<int>(thread::hardware_concurrency());
+            report(move(measurement));
+        }
+        const int remove_count = max(1, corpus_size / 100);
+        {
+            // Same workload on the segmented index; adds include the flushes they trigger
+            string stop_words_text;
+            for (const string& stop_word : stop_words) {
+                stop_words_text += stop_word + ' ';
+            }
+            SegmentedIndex segmented_index(stop_words_text);
+            report(Measure(corpus_size, "segmented_add_document"s, corpus_size, [&](int i) {
+                segmented_index.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }));
+            segmented_index.WaitForMerges();
+            report(Measure(corpus_size, "segmented_find_top_documents_seq"s, query_count, [&](int i) {
+                segmented_index.FindTopDocuments(queries[i]);
+            }));
+            report(Measure(corpus_size, "segmented_find_top_documents_par"s, query_count, [&](int i) {
+                segmented_index.FindTopDocuments(execution::par, queries[i]);
+            }));
+            report(Measure(corpus_size, "segmented_remove_document"s, remove_count, [&](int i) {
+                segmented_index.RemoveDocument(i);
+            }));
+        }
+        report(Measure(corpus_size, "remove_document_seq"s, remove_count, [&](int i) {
+            search_server.RemoveDocument(execution::seq, i);
+        }));
+        report(Measure(corpus_size, "remove_document_par"s, remove_count, [&](int i) {
+            search_server.RemoveDocument(execution::par, remove_count + i);
+        }));
+    }
+
+    const AdaptiveExecutionStats adaptive_paths = GetAdaptiveExecutionStats();
+    cout << "{\n  \"config\": {\"seed\": "s << config.seed
+         << ", \"queries\": "s << config.query_count
+         << ", \"dictionary_size\": "s << dictionary.size()
+         << ", \"minus_prob\": "s << config.minus_prob
+         << ", \"zipf_exponent\": "s << config.zipf_exponent << "},\n"s
+         << "  \"results\": ["s << results.str() << "\n  ],\n"s
+         << "  \"adaptive_paths\": {\"sequential\": "s << adaptive_paths.sequential
+         << ", \"parallel\": "s << adaptive_paths.parallel
+         << ", \"batched\": "s << adaptive_paths.batched << "},\n"s
+         << "  \"peak_rss_kb\": "s << GetPeakRssKb() << "\n}"s << endl;
+    return 0;
+}
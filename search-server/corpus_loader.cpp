@@ -0,0 +1,230 @@
+#include "corpus_loader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <execution>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct ParsedRecord {
+    int id;
+    DocumentStatus status;
+    vector<int> ratings;
+    string_view text;
+};
+
+class FileDescriptor {
+public:
+    explicit FileDescriptor(const string& path)
+        : fd_(open(path.c_str(), O_RDONLY)) {
+        if (fd_ < 0) {
+            throw system_error(errno, generic_category(), "open "s + path);
+        }
+    }
+
+    ~FileDescriptor() {
+        close(fd_);
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+};
+
+struct MappedWindow {
+    void* address = nullptr;
+    size_t mapped_size = 0;
+    // Whole records only: ends right after a newline unless it is the end of the file
+    string_view data;
+    size_t next_offset = 0;
+    vector<vector<ParsedRecord>> chunks;
+
+    MappedWindow() = default;
+    MappedWindow(const MappedWindow&) = delete;
+    MappedWindow& operator=(const MappedWindow&) = delete;
+
+    ~MappedWindow() {
+        if (address != nullptr) {
+            munmap(address, mapped_size);
+        }
+    }
+};
+
+[[noreturn]] void ThrowInvalidRecord(string_view line) {
+    constexpr size_t MAX_QUOTED_SIZE = 64;
+    throw invalid_argument("Invalid corpus record: "s + string(line.substr(0, MAX_QUOTED_SIZE)));
+}
+
+string_view NextField(string_view& line) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        ThrowInvalidRecord(line);
+    }
+    const string_view field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return field;
+}
+
+int ParseInt(string_view text, string_view line) {
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size()) {
+        ThrowInvalidRecord(line);
+    }
+    return value;
+}
+
+ParsedRecord ParseRecord(string_view line) {
+    string_view rest = line;
+    ParsedRecord record;
+    record.id = ParseInt(NextField(rest), line);
+    record.status = ParseDocumentStatus(NextField(rest));
+    string_view ratings = NextField(rest);
+    while (!ratings.empty()) {
+        const size_t comma = min(ratings.find(','), ratings.size());
+        record.ratings.push_back(ParseInt(ratings.substr(0, comma), line));
+        ratings.remove_prefix(min(comma + 1, ratings.size()));
+    }
+    if (record.ratings.empty()) {
+        ThrowInvalidRecord(line);
+    }
+    record.text = rest;
+    return record;
+}
+
+vector<ParsedRecord> ParseChunk(string_view chunk) {
+    vector<ParsedRecord> records;
+    while (!chunk.empty()) {
+        const size_t end = min(chunk.find('\n'), chunk.size());
+        string_view line = chunk.substr(0, end);
+        chunk.remove_prefix(min(end + 1, chunk.size()));
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            records.push_back(ParseRecord(line));
+        }
+    }
+    return records;
+}
+
+unique_ptr<MappedWindow> MapWindow(int fd, size_t file_size, size_t offset, const CorpusLoaderOptions& options) {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned_offset = offset - offset % page_size;
+    const size_t skip = offset - aligned_offset;
+
+    auto window = make_unique<MappedWindow>();
+    window->mapped_size = min(options.window_size + skip, file_size - aligned_offset);
+    void* address = mmap(nullptr, window->mapped_size, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned_offset));
+    if (address == MAP_FAILED) {
+        throw system_error(errno, generic_category(), "mmap"s);
+    }
+    window->address = address;
+    madvise(address, window->mapped_size, MADV_SEQUENTIAL);
+
+    string_view data(static_cast<const char*>(address) + skip, window->mapped_size - skip);
+    if (aligned_offset + window->mapped_size < file_size) {
+        const size_t last_newline = data.rfind('\n');
+        if (last_newline == string_view::npos) {
+            throw invalid_argument("Corpus record is larger than the mapping window"s);
+        }
+        data = data.substr(0, last_newline + 1);
+    }
+    window->data = data;
+    window->next_offset = offset + data.size();
+
+    vector<string_view> chunks;
+    while (!data.empty()) {
+        size_t end = data.size();
+        if (options.chunk_size < data.size()) {
+            const size_t newline = data.find('\n', options.chunk_size);
+            end = newline == string_view::npos ? data.size() : newline + 1;
+        }
+        chunks.push_back(data.substr(0, end));
+        data.remove_prefix(end);
+    }
+    window->chunks.resize(chunks.size());
+    // An exception escaping a parallel algorithm terminates the program, so errors are carried out
+    vector<exception_ptr> errors(chunks.size());
+    vector<size_t> indexes(chunks.size());
+    iota(indexes.begin(), indexes.end(), size_t{0});
+    for_each(execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        try {
+            window->chunks[index] = ParseChunk(chunks[index]);
+        } catch (...) {
+            errors[index] = current_exception();
+        }
+    });
+    for (const auto& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    return window;
+}
+
+} // namespace
+
+double CorpusLoadStats::GetThroughputMBps() const {
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const string& path, const CorpusLoaderOptions& options) {
+    if (options.window_size == 0 || options.chunk_size == 0) {
+        throw invalid_argument("Window and chunk sizes must be positive"s);
+    }
+    const auto start = chrono::steady_clock::now();
+    const FileDescriptor file(path);
+    struct stat file_stat{};
+    if (fstat(file.Get(), &file_stat) < 0) {
+        throw system_error(errno, generic_category(), "fstat "s + path);
+    }
+    const auto file_size = static_cast<size_t>(file_stat.st_size);
+
+    CorpusLoadStats stats;
+    const auto map_window = [&](size_t offset) {
+        return async(launch::async, MapWindow, file.Get(), file_size, offset, cref(options));
+    };
+    // The next window is mapped and parsed while the current one is being ingested
+    future<unique_ptr<MappedWindow>> next_window;
+    if (file_size > 0) {
+        next_window = map_window(0);
+    }
+    while (next_window.valid()) {
+        const auto window = next_window.get();
+        if (window->next_offset < file_size) {
+            next_window = map_window(window->next_offset);
+        }
+        for (const auto& chunk : window->chunks) {
+            for (const ParsedRecord& record : chunk) {
+                search_server.AddDocument(record.id, record.text, record.status, record.ratings);
+            }
+            stats.documents += chunk.size();
+        }
+        stats.bytes += window->data.size();
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "search_server.h"
+#include <cstddef>
+#include <string>
+
+// Corpus file format, one record per line, fields separated by tabs:
+//   <id>\t<status>\t<rating>[,<rating>...]\t<text>
+// status is one of ACTUAL, IRRELEVANT, BANNED, REMOVED.
+struct CorpusLoaderOptions {
+    // At most two windows are mapped at once (one parsed while the previous one is
+    // ingested), which bounds resident memory for files larger than RAM
+    size_t window_size = size_t{64} << 20;
+    // Records are parsed in parallel in chunks of about this size
+    size_t chunk_size = size_t{1} << 20;
+};
+
+struct CorpusLoadStats {
+    size_t bytes = 0;
+    size_t documents = 0;
+    double seconds = 0.0;
+
+    double GetThroughputMBps() const;
+};
+
+// Memory-maps path and adds every record to search_server. Document text is passed
+// to AddDocument as views into the mapping, without copying. Throws
+// std::system_error on I/O failures and std::invalid_argument on malformed records.
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path,
+                           const CorpusLoaderOptions& options = {});
@@ -1,5 +1,7 @@
 #include "document.h"
 #include <iostream>
+#include <stdexcept>
+#include <string>
 using namespace std;
 
 Document::Document(int id, double relevance, int rating)
@@ -14,4 +16,46 @@ ostream& operator<<(ostream& out, const Document& document) {
         << "relevance = "s << document.relevance << ", "s
         << "rating = "s << document.rating << " }"s;
     return out;
-}
\ No newline at end of file
+}
+
+bool IsRankedBefore(const Document& lhs, const Document& rhs) {
+    if (lhs.relevance != rhs.relevance) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+int ComputeAverageRating(const vector<int>& ratings) {
+    int rating_sum = 0;
+    for (const int rating : ratings) {
+        rating_sum += rating;
+    }
+    return rating_sum / static_cast<int>(ratings.size());
+}
+
+string_view DocumentStatusToString(DocumentStatus status) {
+    switch (status) {
+    case DocumentStatus::ACTUAL:
+        return "ACTUAL"sv;
+    case DocumentStatus::IRRELEVANT:
+        return "IRRELEVANT"sv;
+    case DocumentStatus::BANNED:
+        return "BANNED"sv;
+    case DocumentStatus::REMOVED:
+        return "REMOVED"sv;
+    }
+    return "UNKNOWN"sv;
+}
+
+DocumentStatus ParseDocumentStatus(string_view text) {
+    for (const auto status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                              DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+        if (text == DocumentStatusToString(status)) {
+            return status;
+        }
+    }
+    throw invalid_argument("Unknown document status "s + string(text));
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 enum class DocumentStatus {
     ACTUAL,
     IRRELEVANT,
@@ -17,4 +19,15 @@ struct Document {
     int rating = 0;
 };
 
-std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
+std::ostream& operator<<(std::ostream& out, const Document& document);
+
+// Strict total order of results: relevance compared exactly, then rating, then id.
+// Unlike the epsilon comparison of SearchServer::FindTopDocuments it is transitive,
+// so it can order cursors and heaps.
+bool IsRankedBefore(const Document& lhs, const Document& rhs);
+
+int ComputeAverageRating(const std::vector<int>& ratings);
+
+std::string_view DocumentStatusToString(DocumentStatus status);
+// Accepts the enumerator names; throws std::invalid_argument otherwise
+DocumentStatus ParseDocumentStatus(std::string_view text);
@@ -0,0 +1,170 @@
+#include "query_generators.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+class LineConnection {
+public:
+    LineConnection(const string& host, uint16_t port) {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (fd_ < 0 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1
+            || connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            throw system_error(errno, generic_category(), "connect");
+        }
+        const int enable = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    ~LineConnection() {
+        close(fd_);
+    }
+
+    void Send(string_view data) {
+        while (!data.empty()) {
+            const ssize_t count = write(fd_, data.data(), data.size());
+            if (count <= 0) {
+                throw system_error(errno, generic_category(), "write");
+            }
+            data.remove_prefix(count);
+        }
+    }
+
+    string ReadLine() {
+        for (;;) {
+            const size_t end = buffer_.find('\n');
+            if (end != string::npos) {
+                string line = buffer_.substr(0, end);
+                buffer_.erase(0, end + 1);
+                return line;
+            }
+            char chunk[16 * 1024];
+            const ssize_t count = read(fd_, chunk, sizeof(chunk));
+            if (count <= 0) {
+                throw runtime_error("Connection closed by server"s);
+            }
+            buffer_.append(chunk, count);
+        }
+    }
+
+private:
+    int fd_ = -1;
+    string buffer_;
+};
+
+double Percentile(const vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t index = min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    return sorted[index];
+}
+
+vector<double> RunClient(const string& host, uint16_t port, const vector<string>& queries, size_t depth) {
+    LineConnection connection(host, port);
+    vector<double> latencies_us;
+    latencies_us.reserve(queries.size());
+    deque<Clock::time_point> in_flight;
+    size_t sent = 0;
+    while (latencies_us.size() < queries.size()) {
+        string batch;
+        while (sent < queries.size() && in_flight.size() < depth) {
+            batch += "SEARCH "s + queries[sent++] + '\n';
+            in_flight.push_back(Clock::now());
+        }
+        if (!batch.empty()) {
+            connection.Send(batch);
+        }
+        const string response = connection.ReadLine();
+        if (response.rfind("OK"s, 0) != 0) {
+            cerr << "Unexpected response: "s << response << endl;
+        }
+        latencies_us.push_back(chrono::duration<double, micro>(Clock::now() - in_flight.front()).count());
+        in_flight.pop_front();
+    }
+    return latencies_us;
+}
+
+} // namespace
+
+// Usage: load_generator [host] [port] [connections] [queries per connection] [pipeline depth] [documents]
+int main(int argc, char* argv[]) {
+    const string host = argc > 1 ? argv[1] : "127.0.0.1"s;
+    const auto port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 8080);
+    const int connection_count = argc > 3 ? atoi(argv[3]) : 4;
+    const int query_count = argc > 4 ? atoi(argv[4]) : 1000;
+    const size_t depth = argc > 5 ? atoi(argv[5]) : 8;
+    const int document_count = argc > 6 ? atoi(argv[6]) : 10'000;
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, document_count, 70);
+    {
+        LineConnection loader(host, port);
+        string batch;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            batch += "ADD "s + to_string(i) + " ACTUAL 1,2,3 "s + documents[i] + '\n';
+        }
+        loader.Send(batch);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            loader.ReadLine();
+        }
+    }
+
+    vector<vector<string>> client_queries;
+    for (int i = 0; i < connection_count; ++i) {
+        client_queries.push_back(GenerateQueries(generator, dictionary, query_count, 7));
+    }
+
+    vector<vector<double>> client_latencies(connection_count);
+    const auto start = Clock::now();
+    {
+        vector<thread> clients;
+        for (int i = 0; i < connection_count; ++i) {
+            clients.emplace_back([&, i] {
+                client_latencies[i] = RunClient(host, port, client_queries[i], depth);
+            });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+    }
+    const double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<double> latencies;
+    for (const auto& client : client_latencies) {
+        latencies.insert(latencies.end(), client.begin(), client.end());
+    }
+    sort(latencies.begin(), latencies.end());
+
+    cout << "requests: "s << latencies.size() << endl;
+    cout << "qps: "s << latencies.size() / seconds << endl;
+    cout << "latency p50 us: "s << Percentile(latencies, 0.50) << endl;
+    cout << "latency p90 us: "s << Percentile(latencies, 0.90) << endl;
+    cout << "latency p99 us: "s << Percentile(latencies, 0.99) << endl;
+    cout << "latency p999 us: "s << Percentile(latencies, 0.999) << endl;
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+// Forwards to an upstream resource and keeps track of the bytes currently held.
+// Counting is atomic; the upstream must itself be thread-safe if the owner
+// allocates from several threads (e.g. parallel RemoveDocument).
+class CountingMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit CountingMemoryResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+    size_t GetBytesInUse() const;
+    size_t GetPeakBytes() const;
+    std::pmr::memory_resource* GetUpstream() const;
+
+private:
+    std::pmr::memory_resource* upstream_;
+    std::atomic<size_t> bytes_in_use_{0};
+    std::atomic<size_t> peak_bytes_{0};
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+struct MemoryUsage {
+    size_t term_dictionary = 0;
+    size_t inverted_postings = 0;
+    size_t forward_index = 0;
+    size_t document_metadata = 0;
+    size_t stop_words = 0;
+
+    size_t Total() const;
+};
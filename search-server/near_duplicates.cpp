@@ -0,0 +1,262 @@
+#include "near_duplicates.h"
+
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// splitmix64 finalizer: a cheap bijection that spreads every input bit over the output
+uint64_t Mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111eb;
+    value ^= value >> 31;
+    return value;
+}
+
+size_t GetSignatureSize(const NearDuplicateOptions& options) {
+    using namespace string_literals;
+    if (options.band_count == 0 || options.rows_per_band == 0) {
+        throw invalid_argument("Band count and rows per band must be positive"s);
+    }
+    return options.band_count * options.rows_per_band;
+}
+
+// Every signature component is the minimum of an independent hash function over the words
+void UpdateSignature(MinHashSignature& signature, string_view word, uint64_t seed) {
+    const uint64_t word_hash = Mix(hash<string_view>{}(word) ^ seed);
+    for (size_t i = 0; i < signature.size(); ++i) {
+        signature[i] = min(signature[i], Mix(word_hash + i * 0x9e3779b97f4a7c15));
+    }
+}
+
+uint64_t ComputeBandHash(const MinHashSignature& signature, size_t band, size_t rows_per_band) {
+    uint64_t band_hash = band;
+    for (size_t row = band * rows_per_band; row < (band + 1) * rows_per_band; ++row) {
+        band_hash = Mix(band_hash ^ signature[row]);
+    }
+    return band_hash;
+}
+
+class DisjointSets {
+public:
+    explicit DisjointSets(size_t size)
+        : parents_(size) {
+        iota(parents_.begin(), parents_.end(), size_t{0});
+    }
+
+    size_t Find(size_t index) {
+        while (parents_[index] != index) {
+            parents_[index] = parents_[parents_[index]];
+            index = parents_[index];
+        }
+        return index;
+    }
+
+    void Unite(size_t lhs, size_t rhs) {
+        lhs = Find(lhs);
+        rhs = Find(rhs);
+        // The smaller index becomes the root, so groups come out ordered by their first id
+        if (lhs != rhs) {
+            parents_[max(lhs, rhs)] = min(lhs, rhs);
+        }
+    }
+
+private:
+    vector<size_t> parents_;
+};
+
+} // namespace
+
+MinHashSignature ComputeMinHashSignature(const vector<string_view>& words, const NearDuplicateOptions& options) {
+    MinHashSignature signature(GetSignatureSize(options), numeric_limits<uint64_t>::max());
+    for (string_view word : words) {
+        UpdateSignature(signature, word, options.seed);
+    }
+    return signature;
+}
+
+MinHashSignature ComputeMinHashSignature(WordFrequencies word_freqs, const NearDuplicateOptions& options) {
+    MinHashSignature signature(GetSignatureSize(options), numeric_limits<uint64_t>::max());
+    for (const auto& word_freq : word_freqs) {
+        UpdateSignature(signature, word_freq.word, options.seed);
+    }
+    return signature;
+}
+
+double EstimateSimilarity(const MinHashSignature& lhs, const MinHashSignature& rhs) {
+    if (lhs.empty() || lhs.size() != rhs.size()) {
+        return 0.0;
+    }
+    size_t equal_count = 0;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        equal_count += lhs[i] == rhs[i];
+    }
+    return static_cast<double>(equal_count) / lhs.size();
+}
+
+NearDuplicateDetector::NearDuplicateDetector(NearDuplicateOptions options)
+    : options_(options)
+    , bands_(options.band_count) {
+    GetSignatureSize(options_);
+}
+
+optional<int> NearDuplicateDetector::FindDuplicate(const MinHashSignature& signature) const {
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        const auto bucket = bands_[band].find(ComputeBandHash(signature, band, options_.rows_per_band));
+        if (bucket == bands_[band].end()) {
+            continue;
+        }
+        for (const int document_id : bucket->second) {
+            if (EstimateSimilarity(signature, signatures_.at(document_id)) >= options_.min_similarity) {
+                return document_id;
+            }
+        }
+    }
+    return nullopt;
+}
+
+void NearDuplicateDetector::Add(int document_id, MinHashSignature signature) {
+    using namespace string_literals;
+    if (signature.size() != options_.band_count * options_.rows_per_band) {
+        throw invalid_argument("Signature size does not match the detector options"s);
+    }
+    Remove(document_id);
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        bands_[band][ComputeBandHash(signature, band, options_.rows_per_band)].push_back(document_id);
+    }
+    signatures_.emplace(document_id, move(signature));
+}
+
+void NearDuplicateDetector::Remove(int document_id) {
+    const auto signature = signatures_.find(document_id);
+    if (signature == signatures_.end()) {
+        return;
+    }
+    for (size_t band = 0; band < bands_.size(); ++band) {
+        const auto bucket = bands_[band].find(ComputeBandHash(signature->second, band, options_.rows_per_band));
+        auto& document_ids = bucket->second;
+        document_ids.erase(find(document_ids.begin(), document_ids.end(), document_id));
+        if (document_ids.empty()) {
+            bands_[band].erase(bucket);
+        }
+    }
+    signatures_.erase(signature);
+}
+
+const NearDuplicateOptions& NearDuplicateDetector::GetOptions() const {
+    return options_;
+}
+
+optional<int> AddDocumentDeduplicated(SearchServer& search_server, NearDuplicateDetector& detector,
+                                      int document_id, string_view document, DocumentStatus status,
+                                      const vector<int>& ratings, DuplicatePolicy policy) {
+    using namespace string_literals;
+    if (document_id < 0 || search_server.HasDocument(document_id)) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    // The signature is taken from the terms the server would index, so it matches what
+    // FindNearDuplicateGroups sees; invalid words throw before anything is changed
+    AnalyzedText storage;
+    auto signature = ComputeMinHashSignature(search_server.GetDocumentTerms(document, storage), detector.GetOptions());
+    optional<int> duplicate;
+    while ((duplicate = detector.FindDuplicate(signature)) && !search_server.HasDocument(*duplicate)) {
+        detector.Remove(*duplicate);
+    }
+    if (duplicate && policy == DuplicatePolicy::REJECT) {
+        return duplicate;
+    }
+    search_server.AddDocument(document_id, document, status, ratings);
+    if (duplicate) {
+        search_server.SetDocumentGroup(document_id, search_server.GetDocumentGroup(*duplicate));
+    }
+    // Grouped copies are indexed too, so the group is still found once its first member is removed
+    detector.Add(document_id, move(signature));
+    return duplicate;
+}
+
+vector<vector<int>> FindNearDuplicateGroups(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    GetSignatureSize(options);
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    vector<MinHashSignature> signatures(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), signatures.begin(), [&](int document_id) {
+        return ComputeMinHashSignature(search_server.GetWordFrequenciesView(document_id), options);
+    });
+
+    // Within a bucket every member is compared with one representative of each cluster
+    // found so far in the bucket and becomes a new representative if it matches none.
+    // Huge buckets of exact copies stay linear, and a false candidate coming first does
+    // not hide true pairs behind it; union-find joins clusters across buckets and bands.
+    vector<vector<pair<size_t, size_t>>> band_pairs(options.band_count);
+    vector<size_t> bands(options.band_count);
+    iota(bands.begin(), bands.end(), size_t{0});
+    for_each(execution::par, bands.begin(), bands.end(), [&](size_t band) {
+        vector<pair<uint64_t, size_t>> band_hashes(signatures.size());
+        for (size_t i = 0; i < signatures.size(); ++i) {
+            band_hashes[i] = {ComputeBandHash(signatures[i], band, options.rows_per_band), i};
+        }
+        sort(band_hashes.begin(), band_hashes.end());
+        vector<size_t> representatives;
+        for (size_t begin = 0, end = 0; begin < band_hashes.size(); begin = end) {
+            representatives.assign(1, band_hashes[begin].second);
+            end = begin + 1;
+            for (; end < band_hashes.size() && band_hashes[end].first == band_hashes[begin].first; ++end) {
+                const size_t other = band_hashes[end].second;
+                bool is_matched = false;
+                for (const size_t representative : representatives) {
+                    if (EstimateSimilarity(signatures[representative], signatures[other]) >= options.min_similarity) {
+                        band_pairs[band].emplace_back(representative, other);
+                        is_matched = true;
+                    }
+                }
+                if (!is_matched) {
+                    representatives.push_back(other);
+                }
+            }
+        }
+    });
+
+    DisjointSets sets(document_ids.size());
+    for (const auto& pairs : band_pairs) {
+        for (const auto& [lhs, rhs] : pairs) {
+            sets.Unite(lhs, rhs);
+        }
+    }
+    vector<vector<int>> groups;
+    vector<size_t> group_indexes(document_ids.size(), numeric_limits<size_t>::max());
+    vector<size_t> roots(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        roots[i] = sets.Find(i);
+    }
+    // Roots of groups that have at least one other member
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        if (roots[i] != i && group_indexes[roots[i]] == numeric_limits<size_t>::max()) {
+            group_indexes[roots[i]] = groups.size();
+            groups.push_back({document_ids[roots[i]]});
+        }
+        if (roots[i] != i) {
+            groups[group_indexes[roots[i]]].push_back(document_ids[i]);
+        }
+    }
+    return groups;
+}
+
+void ApplyDuplicateGroups(SearchServer& search_server, const vector<vector<int>>& groups) {
+    for (const auto& group : groups) {
+        if (group.empty()) {
+            continue;
+        }
+        const int group_id = *min_element(group.begin(), group.end());
+        for (const int document_id : group) {
+            search_server.SetDocumentGroup(document_id, group_id);
+        }
+    }
+}
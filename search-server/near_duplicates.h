@@ -0,0 +1,70 @@
+#pragma once
+#include "search_server.h"
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// MinHash over the sets of distinct document words, with LSH banding: two documents
+// become candidates when all rows of at least one band agree, which for Jaccard
+// similarity s happens with probability 1 - (1 - s^rows_per_band)^band_count.
+// Candidates are then confirmed by the share of equal signature components.
+struct NearDuplicateOptions {
+    size_t band_count = 16;
+    size_t rows_per_band = 4;
+    double min_similarity = 0.8;
+    uint64_t seed = 0x9e3779b97f4a7c15;
+};
+
+using MinHashSignature = std::vector<uint64_t>;
+
+MinHashSignature ComputeMinHashSignature(const std::vector<std::string_view>& words,
+                                         const NearDuplicateOptions& options = {});
+MinHashSignature ComputeMinHashSignature(WordFrequencies word_freqs, const NearDuplicateOptions& options = {});
+
+// Estimated Jaccard similarity of the underlying word sets
+double EstimateSimilarity(const MinHashSignature& lhs, const MinHashSignature& rhs);
+
+// Incremental index for deduplication at ingest time. Every band keeps a bucket
+// per band hash, so a lookup costs band_count hash probes plus the candidate checks.
+class NearDuplicateDetector {
+public:
+    explicit NearDuplicateDetector(NearDuplicateOptions options = {});
+
+    // Id of an indexed document similar to signature, if any
+    std::optional<int> FindDuplicate(const MinHashSignature& signature) const;
+    void Add(int document_id, MinHashSignature signature);
+    void Remove(int document_id);
+
+    const NearDuplicateOptions& GetOptions() const;
+
+private:
+    NearDuplicateOptions options_;
+    std::unordered_map<int, MinHashSignature> signatures_;
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> bands_;
+};
+
+enum class DuplicatePolicy {
+    REJECT,
+    GROUP,
+};
+
+// Adds the document unless it is a near duplicate of one already seen by detector.
+// With DuplicatePolicy::GROUP a duplicate is still added, but joins the group of
+// the document it duplicates. Returns the id of that document, if any. Every added
+// document, grouped or not, is put in detector; entries of documents since removed
+// from search_server are evicted when found, so any live member can match.
+std::optional<int> AddDocumentDeduplicated(SearchServer& search_server, NearDuplicateDetector& detector,
+                                           int document_id, std::string_view document, DocumentStatus status,
+                                           const std::vector<int>& ratings,
+                                           DuplicatePolicy policy = DuplicatePolicy::GROUP);
+
+// Offline pass over the whole index: signatures and band buckets are built in
+// parallel, candidates are found by sorting band hashes, and confirmed pairs are
+// merged with union-find. Returns groups of two or more ids, each sorted ascending.
+std::vector<std::vector<int>> FindNearDuplicateGroups(const SearchServer& search_server,
+                                                      const NearDuplicateOptions& options = {});
+
+// Puts every document of each group into the group of its smallest id
+void ApplyDuplicateGroups(SearchServer& search_server, const std::vector<std::vector<int>>& groups);
@@ -11,6 +11,29 @@ vector<vector<Document>> ProcessQueries(const SearchServer& search_server,
     return result;
 }
 
+vector<vector<Document>> ProcessQueries(const AdaptivePolicy&, const SearchServer& search_server,
+    const vector<string>& queries) {
+    vector<vector<Document>> result (queries.size());
+    {
+        // Held only while the batch runs, so that the one-by-one queries are not counted twice
+        const AdaptiveLoadGuard load;
+        if (SelectExecutionPath(AdaptiveOperation::BATCH, queries.size(), load.GetInFlight()) == ExecutionPath::BATCHED) {
+            RecordExecutionPath(ExecutionPath::BATCHED, queries.size());
+            transform(execution::par, queries.begin(), queries.end(), result.begin(), [&](const string& query) { return search_server.FindTopDocuments(execution::seq, query); });
+            return result;
+        }
+    }
+    transform(queries.begin(), queries.end(), result.begin(), [&](const string& query) { return search_server.FindTopDocuments(adaptive_policy, query); });
+    return result;
+}
+
+vector<vector<Document>> ProcessQueries(RequestQueue& request_queue,
+    const vector<string>& queries) {
+    vector<vector<Document>> result (queries.size());
+    transform(execution::par, queries.begin(), queries.end(), result.begin(), [&](const string& query) { return request_queue.AddFindRequest(query); });
+    return result;
+}
+
 vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const vector<string>& queries){
@@ -1,10 +1,23 @@
 #pragma once
 #include "search_server.h"
+#include "request_queue.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries); 
 
+// Runs the queries in parallel, each sequentially, when there are enough of them to
+// occupy the free cores; otherwise one by one, each with the adaptive policy
+std::vector<std::vector<Document>> ProcessQueries(
+    const AdaptivePolicy&,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Same as ProcessQueries, with every request recorded in request_queue
+std::vector<std::vector<Document>> ProcessQueries(
+    RequestQueue& request_queue,
+    const std::vector<std::string>& queries);
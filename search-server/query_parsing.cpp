@@ -0,0 +1,102 @@
+#include "query_parsing.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+struct QueryWord {
+    string_view data;
+    bool is_minus;
+    bool is_required;
+};
+
+QueryWord ParseQueryWord(string_view text) {
+    if (text.empty()) {
+        throw invalid_argument("Query word is empty"s);
+    }
+    string_view word = text;
+    const bool is_minus = word[0] == '-';
+    const bool is_required = word[0] == '+';
+    if (is_minus || is_required) {
+        word = word.substr(1);
+    }
+    if (word.empty() || word[0] == '-' || word[0] == '+' || !IsValidWord(word)) {
+        throw invalid_argument("Query word "s + string(text) + " is invalid");
+    }
+    return {word, is_minus, is_required};
+}
+
+void SortUnique(vector<string_view>& words) {
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+}
+
+} // namespace
+
+QueryWords ParseQueryWords(string_view text, const StopWordSet& stop_words,
+                           const TextAnalyzer* analyzer, AnalyzedText* storage) {
+    QueryWords result;
+    const auto add_word = [&](string_view word, const QueryWord& query_word) {
+        if (stop_words.Contains(word)) {
+            return;
+        }
+        (query_word.is_minus ? result.minus_words : result.plus_words).push_back(word);
+        if (query_word.is_required) {
+            result.required_words.push_back(word);
+        }
+    };
+    if (analyzer != nullptr) {
+        vector<pair<size_t, QueryWord>> word_ends;
+        for (const string_view word : SplitIntoWords(text)) {
+            const auto query_word = ParseQueryWord(word);
+            analyzer->Analyze(query_word.data, *storage);
+            word_ends.emplace_back(storage->size(), query_word);
+        }
+        // Views into storage are taken only once it stops growing
+        size_t term = 0;
+        for (const auto& [end, query_word] : word_ends) {
+            for (; term < end; ++term) {
+                add_word((*storage)[term], query_word);
+            }
+        }
+    } else {
+        for (const string_view word : SplitIntoWords(text)) {
+            const auto query_word = ParseQueryWord(word);
+            add_word(query_word.data, query_word);
+        }
+    }
+    SortUnique(result.plus_words);
+    SortUnique(result.minus_words);
+    SortUnique(result.required_words);
+    return result;
+}
+
+vector<string_view> SplitIntoWordsNoStop(string_view text, const StopWordSet& stop_words,
+                                         const TextAnalyzer* analyzer, AnalyzedText& storage) {
+    vector<string_view> words;
+    if (analyzer != nullptr && IsValidWord(text)) {
+        storage.Clear();
+        analyzer->Analyze(text, storage);
+        for (size_t i = 0; i < storage.size(); ++i) {
+            if (!stop_words.Contains(storage[i])) {
+                words.push_back(storage[i]);
+            }
+        }
+        return words;
+    }
+    // Also reports the invalid word when an analyzer is set
+    for (const string_view word : SplitIntoWords(text)) {
+        if (!IsValidWord(word)) {
+            throw invalid_argument("Word "s + string(word) + " is invalid"s);
+        }
+        if (!stop_words.Contains(word)) {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "stop_word_set.h"
+#include "text_analysis.h"
+
+#include <string_view>
+#include <vector>
+
+// Query words shared by SearchServer and SegmentedIndex, each list sorted and unique
+struct QueryWords {
+    std::vector<std::string_view> plus_words;
+    std::vector<std::string_view> minus_words;
+    // Plus words every result must contain, written +word
+    std::vector<std::string_view> required_words;
+};
+
+// -word excludes documents and +word is required. With an analyzer every word is
+// analyzed on its own, so its terms keep its sign, and views point into storage,
+// which must then be non-null; otherwise they point into text. Stop words are dropped.
+// Throws std::invalid_argument on an invalid word.
+QueryWords ParseQueryWords(std::string_view text, const StopWordSet& stop_words,
+                           const TextAnalyzer* analyzer, AnalyzedText* storage);
+
+// Document terms without stop words, with repeats. Views point into text or, with an
+// analyzer, into storage. Throws std::invalid_argument on an invalid word.
+std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text, const StopWordSet& stop_words,
+                                                   const TextAnalyzer* analyzer, AnalyzedText& storage);
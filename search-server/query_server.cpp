@@ -0,0 +1,414 @@
+#include "query_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <execution>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr int MAX_EVENTS = 64;
+constexpr size_t READ_CHUNK_SIZE = 16 * 1024;
+constexpr size_t MAX_LINE_LENGTH = 1024 * 1024;
+
+[[noreturn]] void ThrowSystemError(const char* what) {
+    throw system_error(errno, generic_category(), what);
+}
+
+void SetNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ThrowSystemError("fcntl");
+    }
+}
+
+string_view NextToken(string_view& text) {
+    const size_t begin = min(text.find_first_not_of(' '), text.size());
+    text.remove_prefix(begin);
+    const size_t end = min(text.find(' '), text.size());
+    const string_view token = text.substr(0, end);
+    text.remove_prefix(end);
+    const size_t rest = min(text.find_first_not_of(' '), text.size());
+    text.remove_prefix(rest);
+    return token;
+}
+
+int ParseInt(string_view text) {
+    if (text.empty()) {
+        throw invalid_argument("Expected a number"s);
+    }
+    int value = 0;
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (error != errc() || end != text.data() + text.size()) {
+        throw invalid_argument("Bad integer "s + string(text));
+    }
+    return value;
+}
+
+vector<int> ParseRatings(string_view text) {
+    vector<int> ratings;
+    while (!text.empty()) {
+        const size_t comma = min(text.find(','), text.size());
+        ratings.push_back(ParseInt(text.substr(0, comma)));
+        text.remove_prefix(min(comma + 1, text.size()));
+    }
+    if (ratings.empty()) {
+        throw invalid_argument("Ratings are empty"s);
+    }
+    return ratings;
+}
+
+// Request errors carry protocol messages; anything else is not shown to clients as is
+string FormatError(const exception& e) {
+    string message = "ERR "s + (dynamic_cast<const invalid_argument*>(&e) != nullptr ? e.what() : "Internal error");
+    replace(message.begin(), message.end(), '\n', ' ');
+    return message;
+}
+
+void CheckDocument(const SearchServer& search_server, int document_id) {
+    if (!search_server.HasDocument(document_id)) {
+        throw invalid_argument("Unknown document "s + to_string(document_id));
+    }
+}
+
+} // namespace
+
+QueryServer::QueryServer(SearchServer& search_server, QueryServerOptions options)
+    : search_server_(search_server)
+    , options_(options) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        ThrowSystemError("socket");
+    }
+    const int enable = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(options_.port);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(listen_fd_, options_.listen_backlog) < 0) {
+        const int error = errno;
+        close(listen_fd_);
+        throw system_error(error, generic_category(), "bind/listen");
+    }
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+    SetNonBlocking(listen_fd_);
+
+    epoll_fd_ = epoll_create1(0);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK);
+    if (epoll_fd_ < 0 || stop_fd_ < 0) {
+        ThrowSystemError("epoll/eventfd");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event);
+    event.data.fd = stop_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event);
+}
+
+QueryServer::~QueryServer() {
+    for (const auto& [fd, _] : connections_) {
+        close(fd);
+    }
+    for (const int fd : {listen_fd_, epoll_fd_, stop_fd_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+uint16_t QueryServer::GetPort() const {
+    return port_;
+}
+
+void QueryServer::Stop() {
+    const uint64_t one = 1;
+    [[maybe_unused]] const auto written = write(stop_fd_, &one, sizeof(one));
+}
+
+void QueryServer::Run() {
+    epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int timeout_ms = -1;
+        if (!pending_.empty()) {
+            const auto elapsed = chrono::steady_clock::now() - batch_started_;
+            const auto left = chrono::duration_cast<chrono::milliseconds>(options_.batch_window - elapsed);
+            // epoll_wait has millisecond resolution, so sub-millisecond windows poll once
+            timeout_ms = max<int>(0, static_cast<int>(left.count()));
+        }
+        const int ready = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            ThrowSystemError("epoll_wait");
+        }
+        for (int i = 0; i < ready; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == stop_fd_) {
+                return;
+            }
+            if (fd == listen_fd_) {
+                AcceptConnections();
+                continue;
+            }
+            const auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            // Lines that arrived before a hangup are still read and answered
+            if (events[i].events & EPOLLIN) {
+                ReadFrom(it->second);
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                it->second.closing = true;
+                UpdateInterest(it->second);
+            }
+            if (events[i].events & EPOLLOUT) {
+                WriteTo(it->second);
+            }
+            CloseIfDone(fd);
+        }
+        if (!pending_.empty()
+            && (pending_.size() >= options_.max_batch_size
+                || chrono::steady_clock::now() - batch_started_ >= options_.batch_window)) {
+            ExecuteBatch();
+        }
+    }
+}
+
+void QueryServer::AcceptConnections() {
+    for (;;) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        const int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        Connection& connection = connections_[fd];
+        connection.fd = fd;
+        UpdateInterest(connection);
+    }
+}
+
+void QueryServer::ReadFrom(Connection& connection) {
+    char buffer[READ_CHUNK_SIZE];
+    // Lines are taken after every chunk, so input never holds more than one partial line
+    // and a chunk. A full batch stops reading; level-triggered epoll reports the rest later.
+    while (!connection.closing && pending_.size() < options_.max_batch_size) {
+        const ssize_t count = read(connection.fd, buffer, sizeof(buffer));
+        if (count > 0) {
+            connection.input.append(buffer, count);
+            TakeLines(connection);
+            continue;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            connection.closing = true;
+        }
+        break;
+    }
+    UpdateInterest(connection);
+}
+
+void QueryServer::TakeLines(Connection& connection) {
+    size_t line_begin = 0;
+    for (size_t line_end; (line_end = connection.input.find('\n', line_begin)) != string::npos;
+         line_begin = line_end + 1) {
+        size_t length = line_end - line_begin;
+        if (length > 0 && connection.input[line_begin + length - 1] == '\r') {
+            --length;
+        }
+        AddPending(connection, connection.input.substr(line_begin, length));
+    }
+    connection.input.erase(0, line_begin);
+    if (connection.input.size() > MAX_LINE_LENGTH) {
+        // Answered after the lines before it, then the connection is closed
+        connection.input.clear();
+        connection.closing = true;
+        AddPending(connection, {}, "ERR Request line is too long"s);
+    }
+}
+
+void QueryServer::AddPending(Connection& connection, string line, string error) {
+    if (pending_.empty()) {
+        batch_started_ = chrono::steady_clock::now();
+    }
+    pending_.push_back({connection.fd, move(line), move(error)});
+    ++connection.in_flight;
+}
+
+void QueryServer::WriteTo(Connection& connection) {
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        const ssize_t count = write(connection.fd, connection.output.data() + written,
+                                    connection.output.size() - written);
+        if (count > 0) {
+            written += count;
+            continue;
+        }
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.output.clear();
+            connection.closing = true;
+            written = 0;
+        }
+        break;
+    }
+    connection.output.erase(0, written);
+    UpdateInterest(connection);
+}
+
+void QueryServer::UpdateInterest(Connection& connection) {
+    // A closing connection is not read any more: with level-triggered epoll a pending
+    // EOF would otherwise be reported on every wait until its responses are written
+    uint32_t events = connection.closing ? 0u : static_cast<uint32_t>(EPOLLIN);
+    if (!connection.output.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (events == connection.events) {
+        return;
+    }
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = connection.fd;
+    // Without any events the fd is unregistered, since epoll reports hangups regardless
+    if (events == 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    } else {
+        epoll_ctl(epoll_fd_, connection.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection.fd, &event);
+    }
+    connection.events = events;
+}
+
+void QueryServer::CloseConnection(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
+
+void QueryServer::CloseIfDone(int fd) {
+    const auto it = connections_.find(fd);
+    if (it != connections_.end() && it->second.closing
+        && it->second.in_flight == 0 && it->second.output.empty()) {
+        CloseConnection(fd);
+    }
+}
+
+void QueryServer::ExecuteBatch() {
+    vector<string> responses(pending_.size());
+    for (size_t begin = 0; begin < pending_.size();) {
+        if (!pending_[begin].error.empty()) {
+            responses[begin] = pending_[begin].error;
+            ++begin;
+            continue;
+        }
+        if (!IsReadRequest(pending_[begin].line)) {
+            // Writes are applied one by one, in arrival order, between read batches
+            responses[begin] = ExecuteRequest(pending_[begin].line);
+            ++begin;
+            continue;
+        }
+        size_t end = begin;
+        while (end < pending_.size() && pending_[end].error.empty() && IsReadRequest(pending_[end].line)) {
+            ++end;
+        }
+        transform(execution::par, pending_.begin() + begin, pending_.begin() + end, responses.begin() + begin,
+                  [this](const PendingRequest& request) { return ExecuteReadRequest(request.line); });
+        begin = end;
+    }
+
+    vector<int> touched;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        const auto it = connections_.find(pending_[i].fd);
+        if (it == connections_.end()) {
+            continue;
+        }
+        it->second.output += responses[i];
+        it->second.output.push_back('\n');
+        --it->second.in_flight;
+        touched.push_back(pending_[i].fd);
+    }
+    pending_.clear();
+
+    sort(touched.begin(), touched.end());
+    touched.erase(unique(touched.begin(), touched.end()), touched.end());
+    for (const int fd : touched) {
+        WriteTo(connections_.at(fd));
+        CloseIfDone(fd);
+    }
+}
+
+bool QueryServer::IsReadRequest(string_view line) {
+    const string_view command = NextToken(line);
+    return command == "SEARCH"sv || command == "MATCH"sv;
+}
+
+string QueryServer::ExecuteReadRequest(string_view line) const {
+    try {
+        const string_view command = NextToken(line);
+        ostringstream out;
+        if (command == "SEARCH"sv) {
+            const auto documents = search_server_.FindTopDocuments(adaptive_policy, line);
+            out << "OK "s << documents.size();
+            for (const Document& document : documents) {
+                out << ' ' << document.id << ':' << document.relevance << ':' << document.rating;
+            }
+        } else {
+            const int document_id = ParseInt(NextToken(line));
+            CheckDocument(search_server_, document_id);
+            const auto [words, status] = search_server_.MatchDocument(line, document_id);
+            out << "OK "s << DocumentStatusToString(status);
+            for (const string_view word : words) {
+                out << ' ' << word;
+            }
+        }
+        return out.str();
+    } catch (const exception& e) {
+        return FormatError(e);
+    }
+}
+
+string QueryServer::ExecuteRequest(string_view line) {
+    try {
+        const string_view command = NextToken(line);
+        if (command == "ADD"sv) {
+            const int document_id = ParseInt(NextToken(line));
+            const DocumentStatus status = ParseDocumentStatus(NextToken(line));
+            const vector<int> ratings = ParseRatings(NextToken(line));
+            search_server_.AddDocument(document_id, line, status, ratings);
+            return "OK"s;
+        }
+        if (command == "REMOVE"sv) {
+            search_server_.RemoveDocument(adaptive_policy, ParseInt(NextToken(line)));
+            return "OK"s;
+        }
+        throw invalid_argument("Unknown command "s + string(command));
+    } catch (const exception& e) {
+        return FormatError(e);
+    }
+}
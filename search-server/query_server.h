@@ -0,0 +1,82 @@
+#pragma once
+#include "search_server.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Line protocol, one request per line, responses in request order per connection:
+//   SEARCH <query>                     -> OK <count> <id>:<relevance>:<rating> ...
+//   MATCH <id> <query>                 -> OK <status> <word> ...
+//   ADD <id> <status> <r1,r2,...> <text> -> OK
+//   REMOVE <id>                        -> OK
+// Any failure is answered with "ERR <message>", e.g. "ERR Unknown document 7" or
+// "ERR Bad integer x"; a line longer than 1 MiB is answered with an error and closes
+// the connection.
+struct QueryServerOptions {
+    uint16_t port = 8080;
+    // Read-only requests arriving within this window are executed as one parallel batch
+    std::chrono::microseconds batch_window{200};
+    size_t max_batch_size = 256;
+    int listen_backlog = 128;
+};
+
+class QueryServer {
+public:
+    QueryServer(SearchServer& search_server, QueryServerOptions options);
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Runs the event loop in the calling thread until Stop() is called
+    void Run();
+    // Safe to call from another thread or from a signal handler
+    void Stop();
+
+    uint16_t GetPort() const;
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        size_t in_flight = 0;
+        // Events registered with epoll; none once a closing connection has nothing to write
+        uint32_t events = 0;
+        bool closing = false;
+    };
+
+    struct PendingRequest {
+        int fd;
+        std::string line;
+        // Set for a request rejected while reading; answered in order instead of executed
+        std::string error;
+    };
+
+    SearchServer& search_server_;
+    QueryServerOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    uint16_t port_ = 0;
+    std::map<int, Connection> connections_;
+    std::vector<PendingRequest> pending_;
+    std::chrono::steady_clock::time_point batch_started_;
+
+    void AcceptConnections();
+    void ReadFrom(Connection& connection);
+    void TakeLines(Connection& connection);
+    void AddPending(Connection& connection, std::string line, std::string error = {});
+    void WriteTo(Connection& connection);
+    void CloseConnection(int fd);
+    void CloseIfDone(int fd);
+    void UpdateInterest(Connection& connection);
+    void ExecuteBatch();
+
+    std::string ExecuteRequest(std::string_view line);
+    std::string ExecuteReadRequest(std::string_view line) const;
+    static bool IsReadRequest(std::string_view line);
+};
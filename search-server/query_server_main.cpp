@@ -0,0 +1,46 @@
+#include "query_server.h"
+#include "search_server.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+QueryServer* running_server = nullptr;
+
+void HandleStopSignal(int) {
+    if (running_server != nullptr) {
+        running_server->Stop();
+    }
+}
+} // namespace
+
+// Usage: query_server [port] [stop words...]
+int main(int argc, char* argv[]) {
+    QueryServerOptions options;
+    if (argc > 1) {
+        options.port = static_cast<uint16_t>(atoi(argv[1]));
+    }
+    string stop_words;
+    for (int i = 2; i < argc; ++i) {
+        stop_words += argv[i];
+        stop_words.push_back(' ');
+    }
+
+    // Calibrate the adaptive cost model before serving, not on the first query
+    GetAdaptiveCostModel();
+    SearchServer search_server(stop_words);
+    QueryServer server(search_server, options);
+    running_server = &server;
+    signal(SIGINT, HandleStopSignal);
+    signal(SIGTERM, HandleStopSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    cerr << "Listening on port "s << server.GetPort() << endl;
+    server.Run();
+    running_server = nullptr;
+    return 0;
+}
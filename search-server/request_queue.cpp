@@ -1,23 +1,175 @@
 #include "request_queue.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server) 
-        : search_server_ (search_server) {
+RequestQueue::RequestQueue(const SearchServer& search_server, size_t capacity)
+        : search_server_(search_server)
+        , capacity_(max<size_t>(capacity, 1))
+        , slots_(make_unique<Slot[]>(capacity_)) {
 }
-    
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
+
+vector<Document> RequestQueue::AddFindRequest(string_view raw_query, DocumentStatus status) {
         return RequestQueue::AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
         });
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
+vector<Document> RequestQueue::AddFindRequest(string_view raw_query) {
         return RequestQueue::AddFindRequest (raw_query, DocumentStatus::ACTUAL);
 }
 
 int RequestQueue::GetNoResultRequests() const {
-        return count_empty_request;
+        return static_cast<int>(GetStats(static_cast<size_t>(min_in_day_), 0).no_result_count);
+}
+
+RequestQueue::CounterShard& RequestQueue::GetShard(array<CounterShard, COUNTER_SHARD_COUNT>& shards) {
+    static atomic<size_t> next_shard{0};
+    thread_local const size_t shard = next_shard.fetch_add(1, memory_order_relaxed) % COUNTER_SHARD_COUNT;
+    return shards[shard];
+}
+
+void RequestQueue::RecordRequest(string_view raw_query, size_t result_count, Clock::time_point start, Clock::time_point end) {
+    const auto latency_ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+
+    auto& shard = GetShard(shards_);
+    shard.request_count.fetch_add(1, memory_order_relaxed);
+    shard.latency_ns.fetch_add(latency_ns, memory_order_relaxed);
+    if (result_count == 0) {
+        shard.no_result_count.fetch_add(1, memory_order_relaxed);
+    }
+
+    const uint64_t ticket = next_ticket_.fetch_add(1, memory_order_relaxed);
+    Slot& slot = slots_[ticket % capacity_];
+    const uint64_t writing = 2 * ticket + 1;
+    // A slot that is being written or already holds a newer record is left alone:
+    // losing one record under a full-ring lap is cheaper than waiting
+    uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+    do {
+        if (sequence % 2 == 1 || sequence >= writing) {
+            return;
+        }
+    } while (!slot.sequence.compare_exchange_weak(sequence, writing, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+
+    slot.timestamp_ns.store(chrono::duration_cast<chrono::nanoseconds>(end.time_since_epoch()).count(),
+                            memory_order_relaxed);
+    slot.latency_ns.store(latency_ns, memory_order_relaxed);
+    slot.query_hash.store(hash<string_view>{}(raw_query), memory_order_relaxed);
+    slot.result_count.store(static_cast<uint32_t>(result_count), memory_order_relaxed);
+    slot.query_length.store(static_cast<uint32_t>(min(raw_query.size(), QUERY_PREFIX_SIZE)), memory_order_relaxed);
+    char prefix[QUERY_PREFIX_SIZE] = {};
+    memcpy(prefix, raw_query.data(), min(raw_query.size(), QUERY_PREFIX_SIZE));
+    for (size_t i = 0; i < QUERY_PREFIX_WORDS; ++i) {
+        uint64_t word;
+        memcpy(&word, prefix + i * sizeof(uint64_t), sizeof(uint64_t));
+        slot.query_prefix[i].store(word, memory_order_relaxed);
+    }
+
+    slot.sequence.store(writing + 1, memory_order_release);
 }
 
-    
-  
+bool RequestQueue::ReadRecord(uint64_t ticket, RequestRecord& record) const {
+    const Slot& slot = slots_[ticket % capacity_];
+    const uint64_t ready = 2 * ticket + 2;
+    if (slot.sequence.load(memory_order_acquire) != ready) {
+        return false;
+    }
+    record.timestamp_ns = slot.timestamp_ns.load(memory_order_relaxed);
+    record.latency_ns = slot.latency_ns.load(memory_order_relaxed);
+    record.query_hash = slot.query_hash.load(memory_order_relaxed);
+    record.result_count = slot.result_count.load(memory_order_relaxed);
+    const uint32_t length = slot.query_length.load(memory_order_relaxed);
+    char prefix[QUERY_PREFIX_SIZE];
+    for (size_t i = 0; i < QUERY_PREFIX_WORDS; ++i) {
+        const uint64_t word = slot.query_prefix[i].load(memory_order_relaxed);
+        memcpy(prefix + i * sizeof(uint64_t), &word, sizeof(uint64_t));
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (slot.sequence.load(memory_order_relaxed) != ready) {
+        return false;
+    }
+    record.query_prefix.assign(prefix, min<size_t>(length, QUERY_PREFIX_SIZE));
+    return true;
+}
+
+RequestQueue::RequestStats RequestQueue::GetStats(size_t last_requests, size_t top_query_count) const {
+    const uint64_t end = next_ticket_.load(memory_order_acquire);
+    const uint64_t begin = end - min<uint64_t>({end, last_requests, capacity_});
+    vector<RequestRecord> records;
+    records.reserve(end - begin);
+    RequestRecord record;
+    for (uint64_t ticket = begin; ticket < end; ++ticket) {
+        if (ReadRecord(ticket, record)) {
+            records.push_back(record);
+        }
+    }
+    return BuildStats(records, top_query_count);
+}
+
+RequestQueue::RequestStats RequestQueue::GetStats(chrono::nanoseconds period, size_t top_query_count) const {
+    const int64_t since = chrono::duration_cast<chrono::nanoseconds>((Clock::now() - period).time_since_epoch()).count();
+    const uint64_t end = next_ticket_.load(memory_order_acquire);
+    const uint64_t begin = end - min<uint64_t>(end, capacity_);
+    vector<RequestRecord> records;
+    RequestRecord record;
+    // Tickets and timestamps are not taken together, so the whole ring is scanned
+    // rather than stopping at the first record older than the period
+    for (uint64_t ticket = end; ticket > begin; --ticket) {
+        if (ReadRecord(ticket - 1, record) && record.timestamp_ns >= since) {
+            records.push_back(record);
+        }
+    }
+    return BuildStats(records, top_query_count);
+}
+
+RequestQueue::RequestTotals RequestQueue::GetTotals() const {
+    RequestTotals totals;
+    for (const auto& shard : shards_) {
+        totals.request_count += shard.request_count.load(memory_order_relaxed);
+        totals.no_result_count += shard.no_result_count.load(memory_order_relaxed);
+        totals.total_latency += chrono::nanoseconds(shard.latency_ns.load(memory_order_relaxed));
+    }
+    return totals;
+}
+
+RequestQueue::RequestStats RequestQueue::BuildStats(const vector<RequestRecord>& records, size_t top_query_count) const {
+    RequestStats stats;
+    stats.request_count = records.size();
+    if (records.empty()) {
+        return stats;
+    }
+    vector<uint64_t> latencies;
+    latencies.reserve(records.size());
+    unordered_map<uint64_t, pair<const RequestRecord*, size_t>> queries;
+    for (const auto& record : records) {
+        if (record.result_count == 0) {
+            ++stats.no_result_count;
+        }
+        latencies.push_back(record.latency_ns);
+        auto& [first, count] = queries[record.query_hash];
+        first = &record;
+        ++count;
+    }
+    stats.no_result_rate = static_cast<double>(stats.no_result_count) / records.size();
+    sort(latencies.begin(), latencies.end());
+    stats.latency_p50 = chrono::nanoseconds(latencies[latencies.size() / 2]);
+    stats.latency_p99 = chrono::nanoseconds(latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)]);
+    stats.latency_max = chrono::nanoseconds(latencies.back());
+
+    vector<pair<const RequestRecord*, size_t>> ranked;
+    ranked.reserve(queries.size());
+    for (const auto& [_, query] : queries) {
+        ranked.push_back(query);
+    }
+    const size_t top_count = min(top_query_count, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + top_count, ranked.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second > rhs.second || (lhs.second == rhs.second && lhs.first->query_prefix < rhs.first->query_prefix);
+    });
+    for (size_t i = 0; i < top_count; ++i) {
+        stats.top_queries.emplace_back(ranked[i].first->query_prefix, ranked[i].second);
+    }
+    return stats;
+}
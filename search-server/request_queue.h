@@ -1,49 +1,101 @@
 #pragma once
 #include "search_server.h"
-#include <vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
-#include <deque>
+#include <utility>
+#include <vector>
 
+// Request statistics over a shared SearchServer. Safe to use from any number of
+// threads at once: every request leaves a fixed-size record in a lock-free ring
+// buffer, and running totals are kept in per-thread counter shards.
 class RequestQueue {
 public:
-    RequestQueue () = default;
-    explicit RequestQueue(const SearchServer& search_server);
-    
+    struct RequestStats {
+        size_t request_count = 0;
+        size_t no_result_count = 0;
+        double no_result_rate = 0.0;
+        std::chrono::nanoseconds latency_p50{0};
+        std::chrono::nanoseconds latency_p99{0};
+        std::chrono::nanoseconds latency_max{0};
+        // Most frequent queries with their counts; long queries are truncated
+        std::vector<std::pair<std::string, size_t>> top_queries;
+    };
+
+    struct RequestTotals {
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        std::chrono::nanoseconds total_latency{0};
+    };
+
+    // The server must outlive the queue; capacity bounds the count- and time-based windows
+    explicit RequestQueue(const SearchServer& search_server, size_t capacity = min_in_day_);
+
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate);
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentStatus status);
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(std::string_view raw_query);
 
+    // Requests with no results among the last min_in_day_ requests
     int GetNoResultRequests() const;
+
+    RequestStats GetStats(size_t last_requests, size_t top_query_count = 10) const;
+    RequestStats GetStats(std::chrono::nanoseconds period, size_t top_query_count = 10) const;
+    RequestTotals GetTotals() const;
+
 private:
-    struct QueryResult {
-        std::vector<Document> search_results_;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t QUERY_PREFIX_WORDS = 3;
+    static constexpr size_t QUERY_PREFIX_SIZE = QUERY_PREFIX_WORDS * sizeof(uint64_t);
+    static constexpr size_t COUNTER_SHARD_COUNT = 64;
+
+    // Seqlock-protected record: sequence is 2 * ticket + 1 while written, 2 * ticket + 2 when ready
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int64_t> timestamp_ns{0};
+        std::atomic<uint64_t> latency_ns{0};
+        std::atomic<uint64_t> query_hash{0};
+        std::atomic<uint32_t> result_count{0};
+        std::atomic<uint32_t> query_length{0};
+        std::array<std::atomic<uint64_t>, QUERY_PREFIX_WORDS> query_prefix{};
+    };
+
+    struct RequestRecord {
+        int64_t timestamp_ns;
+        uint64_t latency_ns;
+        uint64_t query_hash;
+        uint32_t result_count;
+        std::string query_prefix;
     };
-    int time_ = 0;
-    int count_empty_request = 0;
-    std::deque<QueryResult> requests_;
+
+    struct alignas(64) CounterShard {
+        std::atomic<uint64_t> request_count{0};
+        std::atomic<uint64_t> no_result_count{0};
+        std::atomic<uint64_t> latency_ns{0};
+    };
+
     const static int min_in_day_ = 1440;
-    SearchServer search_server_;
+    const SearchServer& search_server_;
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> next_ticket_{0};
+    std::array<CounterShard, COUNTER_SHARD_COUNT> shards_;
+
+    void RecordRequest(std::string_view raw_query, size_t result_count, Clock::time_point start, Clock::time_point end);
+    bool ReadRecord(uint64_t ticket, RequestRecord& record) const;
+    RequestStats BuildStats(const std::vector<RequestRecord>& records, size_t top_query_count) const;
+    static CounterShard& GetShard(std::array<CounterShard, COUNTER_SHARD_COUNT>& shards);
 };
 
 template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-        RequestQueue::time_++;
-        if (time_ > min_in_day_) {
-            RequestQueue::requests_.pop_front();
-        }
-        
-        RequestQueue::QueryResult a;
-        a.search_results_ = RequestQueue::search_server_.FindTopDocuments(raw_query, document_predicate);
-        RequestQueue::requests_.push_back(a);
-        
-        if (a.search_results_.empty() && time_ < min_in_day_) {
-            RequestQueue::count_empty_request++;
-        }
-        if (time_ > min_in_day_  ) {
-                RequestQueue::count_empty_request--;
-            }   
-        return RequestQueue::requests_.back().search_results_;
-    }
\ No newline at end of file
+std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
+    const auto start = Clock::now();
+    auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
+    RecordRequest(raw_query, result.size(), start, Clock::now());
+    return result;
+}
@@ -0,0 +1,66 @@
+#include "search_cursor.h"
+#include <charconv>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+using namespace std;
+
+SearchCursor::SearchCursor(uint64_t generation, const Document& last_document)
+    : is_begin_(false)
+    , generation_(generation)
+    , last_document_(last_document) {
+}
+
+bool SearchCursor::IsBegin() const {
+    return is_begin_;
+}
+
+uint64_t SearchCursor::GetGeneration() const {
+    return generation_;
+}
+
+const Document& SearchCursor::GetLastDocument() const {
+    return last_document_;
+}
+
+string SearchCursor::ToString() const {
+    if (is_begin_) {
+        return {};
+    }
+    // Relevance is stored bit-exact, so the cursor compares equal to the document it came from
+    uint64_t relevance_bits;
+    memcpy(&relevance_bits, &last_document_.relevance, sizeof(relevance_bits));
+    ostringstream out;
+    out << hex << generation_ << '-' << relevance_bits << '-'
+        << static_cast<uint32_t>(last_document_.rating) << '-' << static_cast<uint32_t>(last_document_.id);
+    return out.str();
+}
+
+SearchCursor SearchCursor::FromString(string_view token) {
+    if (token.empty()) {
+        return {};
+    }
+    const string_view original = token;
+    uint64_t fields[4];
+    for (size_t i = 0; i < 4; ++i) {
+        const size_t end = i == 3 ? token.size() : token.find('-');
+        if (end == string_view::npos) {
+            throw invalid_argument("Invalid search cursor"s);
+        }
+        const auto [last, error] = from_chars(token.data(), token.data() + end, fields[i], 16);
+        if (error != errc() || last != token.data() + end) {
+            throw invalid_argument("Invalid search cursor"s);
+        }
+        token.remove_prefix(min(end + 1, token.size()));
+    }
+    double relevance;
+    memcpy(&relevance, &fields[1], sizeof(relevance));
+    SearchCursor result(fields[0], Document(static_cast<int>(static_cast<uint32_t>(fields[3])), relevance,
+                                            static_cast<int>(static_cast<uint32_t>(fields[2]))));
+    // Only the canonical spelling is accepted: no signs, leading zeros, upper case or
+    // values that do not fit the field
+    if (result.ToString() != original) {
+        throw invalid_argument("Invalid search cursor"s);
+    }
+    return result;
+}
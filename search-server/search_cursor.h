@@ -0,0 +1,37 @@
+#pragma once
+#include "document.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Search-after position: the last (relevance, rating, id) returned and, as a hint, the
+// index generation it was computed in. A default-constructed cursor starts from the top.
+class SearchCursor {
+public:
+    SearchCursor() = default;
+    SearchCursor(uint64_t generation, const Document& last_document);
+
+    bool IsBegin() const;
+    uint64_t GetGeneration() const;
+    const Document& GetLastDocument() const;
+
+    // Opaque token for handing the cursor to clients; the empty token is the beginning.
+    // FromString accepts only tokens produced by ToString and throws invalid_argument otherwise.
+    std::string ToString() const;
+    static SearchCursor FromString(std::string_view token);
+
+private:
+    bool is_begin_ = true;
+    uint64_t generation_ = 0;
+    Document last_document_;
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    SearchCursor next;
+    bool has_more = false;
+    // Hint: the cursor came from another index generation, so relevances may have shifted
+    // and documents may have moved across the cursor since the previous page
+    bool index_changed = false;
+};
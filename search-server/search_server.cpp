@@ -1,68 +1,150 @@
 #include "search_server.h"
 #include "log_duration.h"
 #include <cassert>
+#include <limits>
+#include <numeric>
 
 using namespace std;
 
-SearchServer::SearchServer(string_view stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text)) {
+SearchServer::SearchServer(string_view stop_words_text, pmr::memory_resource* resource)
+    : SearchServer(SplitIntoWords(stop_words_text), resource) {
 }
 
-SearchServer::SearchServer(const std::string& stop_words_text)
-    : SearchServer(std::string_view(stop_words_text)) {}
+SearchServer::SearchServer(const std::string& stop_words_text, pmr::memory_resource* resource)
+    : SearchServer(std::string_view(stop_words_text), resource) {}
+
+SearchServer::SearchServer(string_view stop_words_text, shared_ptr<const TextAnalyzer> analyzer,
+                           pmr::memory_resource* resource)
+    : SearchServer(SplitIntoWords(stop_words_text), move(analyzer), resource) {
+}
+
+SearchServer::SearchServer(const string& stop_words_text, shared_ptr<const TextAnalyzer> analyzer,
+                           pmr::memory_resource* resource)
+    : SearchServer(string_view(stop_words_text), move(analyzer), resource) {
+}
+
+SearchServer::SearchServer(const SearchServer& other)
+    : stop_words_resource_(other.stop_words_resource_.GetUpstream())
+    , dictionary_resource_(other.dictionary_resource_.GetUpstream())
+    , postings_resource_(other.postings_resource_.GetUpstream())
+    , forward_index_resource_(other.forward_index_resource_.GetUpstream())
+    , metadata_resource_(other.metadata_resource_.GetUpstream())
+    , stop_words_(other.stop_words_, &stop_words_resource_)
+    , word_to_document_freqs_(&dictionary_resource_)
+    , document_to_word_freqs_(&forward_index_resource_)
+    , documents_(other.documents_, &metadata_resource_)
+    , document_ids_(other.document_ids_, &metadata_resource_)
+    , generation_(other.generation_)
+    , has_document_groups_(other.has_document_groups_)
+    , group_followers_(other.group_followers_, &metadata_resource_)
+    , analyzer_(other.analyzer_) {
+    for (const auto& [word, postings] : other.word_to_document_freqs_) {
+        word_to_document_freqs_.emplace_hint(word_to_document_freqs_.end(), word,
+            PostingList{pmr::map<int, double>(postings.document_freqs, &postings_resource_)});
+    }
+    // Forward index views must point into this server's dictionary, not other's
+    for (const auto& [document_id, other_word_freqs] : other.document_to_word_freqs_) {
+        auto& word_freqs = document_to_word_freqs_.emplace_hint(document_to_word_freqs_.end(),
+            document_id, other_word_freqs)->second;
+        for (auto& word_freq : word_freqs) {
+            word_freq.word = word_to_document_freqs_.find(word_freq.word)->first;
+        }
+    }
+}
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    thread_local AnalyzedText analyzed_words;
+    auto words = SplitIntoWordsNoStop(document, stop_words_, analyzer_.get(), analyzed_words);
     const double inv_word_count = 1.0 / words.size();
-    for (const auto& word : words) {
-        word_to_document_freqs_[std::string(word)][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][std::string(word)] += inv_word_count;
+    sort(words.begin(), words.end());
+    auto& word_freqs = document_to_word_freqs_[document_id];
+    for (auto begin = words.begin(); begin != words.end();) {
+        const auto end = find_if(begin, words.end(), [begin](string_view word) { return word != *begin; });
+        const double term_freq = (end - begin) * inv_word_count;
+        auto postings = word_to_document_freqs_.find(*begin);
+        if (postings == word_to_document_freqs_.end()) {
+            postings = word_to_document_freqs_.emplace(*begin, PostingList{pmr::map<int, double>(&postings_resource_)}).first;
+        }
+        postings->second.document_freqs.emplace(document_id, term_freq);
+        word_freqs.push_back({postings->first, term_freq});
+        begin = end;
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    word_freqs.shrink_to_fit();
+    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, document_id});
     document_ids_.insert(document_id);
+    ++generation_;
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
-    vector<string> vec_words;
-    for (auto& [key, value] : SearchServer::word_to_document_freqs_) {
-        value.erase(document_id);
-        if (value.empty()) {
-            vec_words.push_back(key);
-        }
+    const auto word_freqs = document_to_word_freqs_.find(document_id);
+    if (word_freqs == document_to_word_freqs_.end()) {
+        return;
     }
-
-    for (auto& word : vec_words) {
-        word_to_document_freqs_.erase(word);
+    for (const auto& [word, _] : word_freqs->second) {
+        const auto postings = word_to_document_freqs_.find(word);
+        postings->second.document_freqs.erase(document_id);
+        if (postings->second.document_freqs.empty()) {
+            word_to_document_freqs_.erase(postings);
+        }
     }
 
+    RemoveGroupFollower(document_id);
+    PromoteGroupFollower(document_id);
     documents_.erase(document_id);
     document_ids_.erase(document_id);
-    
+    document_to_word_freqs_.erase(word_freqs);
+    ++generation_;
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    // remove from word_to_document_freqs_
-    auto& m = document_to_word_freqs_.at(document_id);
-    std::vector<std::string*> v(m.size());
-    transform(execution::par, m.begin(), m.end(), v.begin(),
-             [](auto& p) { return const_cast<std::string*>(&(p.first)); } );
+    const auto word_freqs = document_to_word_freqs_.find(document_id);
+    if (word_freqs == document_to_word_freqs_.end()) {
+        return;
+    }
+    // Each word owns a distinct posting list, so they can be erased from concurrently
+    std::vector<PostingList*> v(word_freqs->second.size());
+    transform(execution::par, word_freqs->second.begin(), word_freqs->second.end(), v.begin(),
+             [this](const WordFrequency& p) { return &word_to_document_freqs_.find(p.word)->second; } );
     for_each(execution::par, v.begin(), v.end(),
-             [this, document_id](auto& s)
-             { word_to_document_freqs_[*s].erase(document_id); }
+             [document_id](PostingList* postings)
+             { postings->document_freqs.erase(document_id); }
             );
+    // Erasing from the dictionary itself is not thread-safe
+    for (const auto& [word, _] : word_freqs->second) {
+        const auto postings = word_to_document_freqs_.find(word);
+        if (postings->second.document_freqs.empty()) {
+            word_to_document_freqs_.erase(postings);
+        }
+    }
     
+    RemoveGroupFollower(document_id);
+    PromoteGroupFollower(document_id);
     document_ids_.erase(document_id);
     documents_.erase(document_id);
-    document_to_word_freqs_.erase(document_id);
+    document_to_word_freqs_.erase(word_freqs);
+    ++generation_;
 }    
 
 void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(std::execution::seq, document_id);
 }
 
+void SearchServer::RemoveDocument(const AdaptivePolicy&, int document_id) {
+    const auto word_freqs = document_to_word_freqs_.find(document_id);
+    const size_t word_count = word_freqs == document_to_word_freqs_.end() ? 0 : word_freqs->second.size();
+    const AdaptiveLoadGuard load;
+    const ExecutionPath path = SelectExecutionPath(AdaptiveOperation::REMOVE, word_count, load.GetInFlight());
+    RecordExecutionPath(path);
+    if (path == ExecutionPath::PARALLEL) {
+        RemoveDocument(execution::par, document_id);
+    } else {
+        RemoveDocument(execution::seq, document_id);
+    }
+}
+
 vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, string_view raw_query, DocumentStatus status) const {
     return FindTopDocuments(execution::par,
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
@@ -81,183 +163,350 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentS
         });
 }
 
+SearchPage SearchServer::FindTopDocumentsAfter(string_view raw_query, const SearchCursor& cursor, size_t page_size,
+                                               DocumentStatus status) const {
+    return FindTopDocumentsAfter(
+        raw_query, cursor, page_size, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        });
+}
+
+SearchPage SearchServer::FindTopDocumentsAfter(string_view raw_query, const SearchCursor& cursor, size_t page_size) const {
+    return FindTopDocumentsAfter(raw_query, cursor, page_size, DocumentStatus::ACTUAL);
+}
+
 vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, string_view raw_query) const {
     return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const AdaptivePolicy&, string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(adaptive_policy,
+        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        });
+}
+
+vector<Document> SearchServer::FindTopDocuments(const AdaptivePolicy&, string_view raw_query) const {
+    return FindTopDocuments(adaptive_policy, raw_query, DocumentStatus::ACTUAL);
+}
+
 vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy&, string_view raw_query) const {
     return SearchServer::FindTopDocuments(raw_query);
 }
 
+vector<Document> SearchServer::FindTopDocumentsAllTerms(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocumentsAllTerms(
+        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+            return document_status == status;
+        });
+}
+
+vector<Document> SearchServer::FindTopDocumentsAllTerms(string_view raw_query) const {
+    return FindTopDocumentsAllTerms(raw_query, DocumentStatus::ACTUAL);
+}
+
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
 SearchServer::Query SearchServer::ParseQuerySeq(const string_view text) const {
-    SearchServer::Query result;
-    for (const string_view word : SplitIntoWords(text)) {
-        const auto query_word = SearchServer::ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
-            } else {
-                result.plus_words.push_back(query_word.data);
-            }
-        }
+    SEARCH_STATS_STAGE(PARSE);
+    Query result;
+    if (analyzer_) {
+        result.analyzed_words = make_unique<AnalyzedText>();
     }
-        
-    sort(result.minus_words.begin(), result.minus_words.end());
-    auto minus_words = unique(result.minus_words.begin(), result.minus_words.end());
-    result.minus_words.erase(minus_words, result.minus_words.end());
-        
-    sort(result.plus_words.begin(), result.plus_words.end());
-    auto plus_word = unique(result.plus_words.begin(), result.plus_words.end());
-    result.plus_words.erase(plus_word, result.plus_words.end());
+    static_cast<QueryWords&>(result) = ParseQueryWords(text, stop_words_, analyzer_.get(), result.analyzed_words.get());
     return result;
 }
     
-SearchServer::Query SearchServer::ParseQueryPar(const string_view text) const {
-    SearchServer::Query result;
-    for (const string_view word : SplitIntoWords(text)) {
-        const auto query_word = SearchServer::ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
-            } else {
-                result.plus_words.push_back(query_word.data);
-            }
+SearchServer::ResolvedQuery SearchServer::ResolveQuery(const Query& query) const {
+    ResolvedQuery result;
+    // Dictionary keys keep the lexicographic order of the parsed words
+    for (const string_view word : query.plus_words) {
+        if (const auto postings = word_to_document_freqs_.find(word); postings != word_to_document_freqs_.end()) {
+            result.plus_words.push_back(postings->first);
+        }
+    }
+    for (const string_view word : query.minus_words) {
+        if (const auto postings = word_to_document_freqs_.find(word); postings != word_to_document_freqs_.end()) {
+            result.minus_words.push_back(postings->first);
+        }
+    }
+    for (const string_view word : query.required_words) {
+        if (const auto postings = word_to_document_freqs_.find(word); postings != word_to_document_freqs_.end()) {
+            result.required_words.push_back(postings->first);
+        } else {
+            result.has_missing_required_word = true;
         }
     }
     return result;
 }
 
+size_t SearchServer::MatchResolvedQuery(const ResolvedQuery& query, const pmr::vector<WordFrequency>& word_freqs,
+                                        string_view* matched_words) {
+    // Both sides are sorted, so every probe continues from the previous position.
+    // Resolved words share storage with the forward index, so equality is a pointer check.
+    const auto probe = [&word_freqs](auto& from, string_view word) {
+        from = lower_bound(from, word_freqs.end(), word,
+                           [](const WordFrequency& lhs, string_view rhs) { return lhs.word < rhs; });
+        return from != word_freqs.end() && from->word.data() == word.data();
+    };
+    if (query.has_missing_required_word) {
+        return 0;
+    }
+    auto from = word_freqs.begin();
+    for (const string_view word : query.minus_words) {
+        if (probe(from, word)) {
+            return 0;
+        }
+    }
+    from = word_freqs.begin();
+    for (const string_view word : query.required_words) {
+        if (!probe(from, word)) {
+            return 0;
+        }
+    }
+    size_t count = 0;
+    from = word_freqs.begin();
+    for (const string_view word : query.plus_words) {
+        if (probe(from, word)) {
+            if (matched_words != nullptr) {
+                matched_words[count] = word;
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
     return SearchServer::MatchDocument(execution::seq, raw_query, document_id);
 }
     
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, const string_view raw_query, int document_id) const {
-    SearchServer::Query query = SearchServer::ParseQuerySeq(raw_query);
-    vector<string_view> matched_words;
-    for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-            matched_words.push_back(word);
-        }
+    const auto status = documents_.at(document_id).status;
+    const ResolvedQuery query = ResolveQuery(ParseQuerySeq(raw_query));
+    vector<string_view> matched_words(query.plus_words.size());
+    matched_words.resize(MatchResolvedQuery(query, document_to_word_freqs_.at(document_id), matched_words.data()));
+    return {matched_words, status};
+}
+
+// A single document is matched against a handful of words, which is too little
+// work to split between threads; use MatchDocuments to parallelize across documents
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const string_view raw_query, int document_id) const {
+    return SearchServer::MatchDocument(execution::seq, raw_query, document_id);
+}
+
+MatchedDocuments SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(execution::seq, raw_query, document_ids);
+}
+
+MatchedDocuments SearchServer::MatchDocuments(const execution::sequenced_policy&, string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(execution::seq, raw_query, document_ids);
+}
+
+MatchedDocuments SearchServer::MatchDocuments(const execution::parallel_policy&, string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocumentsImpl(execution::par, raw_query, document_ids);
+}
+
+template <typename ExecutionPolicy>
+MatchedDocuments SearchServer::MatchDocumentsImpl(ExecutionPolicy&& policy, string_view raw_query,
+                                                  const vector<int>& document_ids) const {
+    MatchedDocuments result;
+    vector<const pmr::vector<WordFrequency>*> word_freqs;
+    word_freqs.reserve(document_ids.size());
+    result.statuses.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        result.statuses.push_back(documents_.at(document_id).status);
+        word_freqs.push_back(&document_to_word_freqs_.at(document_id));
     }
-    for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-            matched_words.clear();
-            break;
+    const ResolvedQuery query = ResolveQuery(ParseQuerySeq(raw_query));
+
+    // First pass sizes every document's slice, second pass fills the flat buffer in place
+    vector<size_t> counts(document_ids.size());
+    transform(policy, word_freqs.begin(), word_freqs.end(), counts.begin(),
+              [&query](const auto* document_word_freqs) {
+                  return MatchResolvedQuery(query, *document_word_freqs, nullptr);
+              });
+    result.offsets.resize(document_ids.size() + 1);
+    partial_sum(counts.begin(), counts.end(), result.offsets.begin() + 1);
+    result.words.resize(result.offsets.back());
+
+    vector<size_t> indexes(document_ids.size());
+    iota(indexes.begin(), indexes.end(), size_t{0});
+    for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        if (counts[index] != 0) {
+            MatchResolvedQuery(query, *word_freqs[index], result.words.data() + result.offsets[index]);
         }
-    }
-    return {matched_words, documents_.at(document_id).status};
+    });
+    return result;
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const string_view raw_query, int document_id) const {
-    assert(documents_.count(document_id) > 0);
+size_t MatchedDocuments::size() const {
+    return statuses.size();
+}
 
-    const auto& word_freqs = document_to_word_freqs_.at(document_id);
-    auto query = ParseQueryPar(raw_query);
+IteratorRange<vector<string_view>::const_iterator> MatchedDocuments::GetWords(size_t index) const {
+    return {words.begin() + offsets[index], words.begin() + offsets[index + 1]};
+}
 
-    if (any_of(execution::par, query.minus_words.begin(),
-                    query.minus_words.end(),
-                    [&word_freqs](const std::string_view word) {
-                        return word_freqs.count(word) > 0;
-                    })) {
-        return { {}, documents_.at(document_id).status };
+void SearchServer::SeekPosting(const pmr::map<int, double>& postings, pmr::map<int, double>::const_iterator& current,
+                               int document_id) {
+    // Galloping over a tree: a few steps cover dense lists, longer gaps are skipped
+    // through the tree in O(log n) instead of being walked
+    const int LINEAR_SEEK_STEPS = 4;
+    for (int step = 0; step < LINEAR_SEEK_STEPS; ++step) {
+        if (current == postings.end() || current->first >= document_id) {
+            return;
+        }
+        ++current;
     }
-    
-    vector<string_view> matched_words;
-    matched_words.reserve(query.plus_words.size());
-    copy_if(execution::par, query.plus_words.begin(),
-                 query.plus_words.end(), back_inserter(matched_words),
-                 [&word_freqs](const string_view word) {
-                     return word_freqs.count(word) > 0;
-                 });
-    
-    sort(execution::par, matched_words.begin(),matched_words.end());
-    auto it_last = unique(execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(it_last, matched_words.end());
-    return { matched_words, documents_.at(document_id).status };  
+    if (current != postings.end() && current->first < document_id) {
+        current = postings.lower_bound(document_id);
     }
+}
 
 double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(std::string(word)).size());
+    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.find(word)->second.document_freqs.size());
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static map<string_view, double> result;
-    if (!document_to_word_freqs_.count(document_id)) {
-        return result;
+WordFrequencies SearchServer::GetWordFrequenciesView(int document_id) const {
+    static const pmr::vector<WordFrequency> empty;
+    const auto word_freqs = document_to_word_freqs_.find(document_id);
+    if (word_freqs == document_to_word_freqs_.end()) {
+        return {empty.begin(), empty.end()};
     }
-    for (const auto& [k, v] : document_to_word_freqs_.at(document_id)) {
-        result.insert(pair{string_view(k), v});
+    return {word_freqs->second.begin(), word_freqs->second.end()};
+}
+
+vector<string_view> SearchServer::GetDocumentTerms(string_view document, AnalyzedText& storage) const {
+    return SplitIntoWordsNoStop(document, stop_words_, analyzer_.get(), storage);
+}
+
+const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
+    thread_local map<string_view, double> result;
+    result.clear();
+    for (const auto& [word, frequency] : GetWordFrequenciesView(document_id)) {
+        result.emplace_hint(result.end(), word, frequency);
     }
     return result;
 }
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+void SearchServer::SetDocumentGroup(int document_id, int group_id) {
+    auto& document_data = documents_.at(document_id);
+    if (documents_.count(group_id) == 0) {
+        throw invalid_argument("Document group must be the id of a document"s);
+    }
+    RemoveGroupFollower(document_id);
+    document_data.group_id = group_id;
+    if (group_id != document_id) {
+        group_followers_[group_id].insert(document_id);
+    }
+    has_document_groups_ = has_document_groups_ || group_id != document_id;
 }
 
-set<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.cbegin();
+int SearchServer::GetDocumentGroup(int document_id) const {
+    return documents_.at(document_id).group_id;
 }
 
-set<int>::const_iterator SearchServer::end() const {
-    return document_ids_.cend();
+bool SearchServer::IsInSharedGroup(int document_id, const DocumentData& document_data) const {
+    return document_data.group_id != document_id || group_followers_.count(document_id) > 0;
 }
 
-bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(string(word)) > 0;
+void SearchServer::RemoveGroupFollower(int document_id) {
+    const int group_id = documents_.at(document_id).group_id;
+    if (group_id == document_id) {
+        return;
+    }
+    const auto followers = group_followers_.find(group_id);
+    followers->second.erase(document_id);
+    if (followers->second.empty()) {
+        group_followers_.erase(followers);
+    }
 }
 
-bool SearchServer::IsValidWord(string_view word) {
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
+void SearchServer::PromoteGroupFollower(int document_id) {
+    const auto followers = group_followers_.find(document_id);
+    if (followers == group_followers_.end()) {
+        return;
+    }
+    pmr::set<int> members = move(followers->second);
+    group_followers_.erase(followers);
+    const int leader_id = *members.begin();
+    members.erase(members.begin());
+    documents_.at(leader_id).group_id = leader_id;
+    for (const int member_id : members) {
+        documents_.at(member_id).group_id = leader_id;
+    }
+    if (!members.empty()) {
+        // The new leader may already lead followers of its own
+        group_followers_[leader_id].merge(members);
+    }
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (const auto& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+void SearchServer::CollapseDocumentGroups(vector<Document>& documents) const {
+    vector<int> seen_groups;
+    seen_groups.reserve(MAX_RESULT_DOCUMENT_COUNT);
+    size_t kept = 0;
+    for (size_t i = 0; i < documents.size() && kept < MAX_RESULT_DOCUMENT_COUNT; ++i) {
+        const int group_id = documents_.at(documents[i].id).group_id;
+        if (find(seen_groups.begin(), seen_groups.end(), group_id) == seen_groups.end()) {
+            seen_groups.push_back(group_id);
+            documents[kept++] = documents[i];
         }
     }
-    return words;
+    documents.resize(kept);
 }
 
-int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
-    int rating_sum = 0;
-    for (const int rating : ratings) {
-        rating_sum += rating;
-    }
-    return rating_sum / static_cast<int>(ratings.size());
+int SearchServer::GetDocumentCount() const {
+    return documents_.size();
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
-    if (text.empty()) {
-        throw invalid_argument("Query word is empty"s);
-    }
-    string_view word = text;
-    bool is_minus = false;
-    if (word[0] == '-') {
-        is_minus = true;
-        word = word.substr(1);
+bool SearchServer::HasDocument(int document_id) const {
+    return documents_.count(document_id) > 0;
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
+MemoryUsage SearchServer::GetMemoryUsage() const {
+    MemoryUsage usage;
+    usage.term_dictionary = dictionary_resource_.GetBytesInUse();
+    usage.inverted_postings = postings_resource_.GetBytesInUse();
+    usage.forward_index = forward_index_resource_.GetBytesInUse();
+    usage.document_metadata = metadata_resource_.GetBytesInUse();
+    usage.stop_words = stop_words_resource_.GetBytesInUse();
+    return usage;
+}
+
+pmr::set<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.cbegin();
+}
+
+pmr::set<int>::const_iterator SearchServer::end() const {
+    return document_ids_.cend();
+}
+
+size_t SearchServer::CountQueryPostings(const Query& query) const {
+    if (!query.required_words.empty()) {
+        // The intersection is driven by the shortest required list, one seek per term
+        size_t shortest = numeric_limits<size_t>::max();
+        for (const string_view word : query.required_words) {
+            const auto postings = word_to_document_freqs_.find(word);
+            shortest = min(shortest, postings == word_to_document_freqs_.end() ? 0 : postings->second.document_freqs.size());
+        }
+        return shortest * (query.plus_words.size() + query.minus_words.size());
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
-        throw invalid_argument("Query word "s + string(text) + " is invalid");
+    size_t posting_count = 0;
+    for (const auto* words : {&query.plus_words, &query.minus_words}) {
+        for (const string_view word : *words) {
+            if (const auto postings = word_to_document_freqs_.find(word); postings != word_to_document_freqs_.end()) {
+                posting_count += postings->second.document_freqs.size();
+            }
+        }
     }
-    return {word, is_minus, IsStopWord(word)};
+    return posting_count;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, string_view document,
@@ -12,18 +12,66 @@
 #include <execution>
 #include <type_traits>
 #include <future>
+#include <memory>
+#include <memory_resource>
 
+#include "adaptive_execution.h"
 #include "document.h"
 #include "string_processing.h"
 #include "concurrent_map.h"
+#include "search_stats.h"
+#include "memory_accounting.h"
+#include "paginator.h"
+#include "query_parsing.h"
+#include "search_cursor.h"
+#include "stop_word_set.h"
+#include "text_analysis.h"
+
+struct WordFrequency {
+    std::string_view word;
+    double frequency;
+};
+
+// Points into the server's own storage; valid until the document is removed
+using WordFrequencies = IteratorRange<std::pmr::vector<WordFrequency>::const_iterator>;
+
+// Results of MatchDocuments in one flat buffer: the words matched in the i-th
+// requested document are words[offsets[i], offsets[i + 1])
+struct MatchedDocuments {
+    std::vector<std::string_view> words;
+    std::vector<size_t> offsets;
+    std::vector<DocumentStatus> statuses;
+
+    size_t size() const;
+    IteratorRange<std::vector<std::string_view>::const_iterator> GetWords(size_t index) const;
+};
 
 class SearchServer {
 public:
+    // All index containers allocate from per-subsystem counters on top of resource
+    template <typename StringContainer>
+    explicit SearchServer(const StringContainer& stop_words,
+                          std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    explicit SearchServer(std::string_view stop_words_text,
+                          std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    SearchServer(const std::string& text, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Documents, stop words and query words all go through analyzer. Without one,
+    // text is split on spaces and words are indexed as they are.
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
-    explicit SearchServer(std::string_view stop_words_text);
-    SearchServer(const std::string& text);
+    SearchServer(const StringContainer& stop_words, std::shared_ptr<const TextAnalyzer> analyzer,
+                 std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    SearchServer(std::string_view stop_words_text, std::shared_ptr<const TextAnalyzer> analyzer,
+                 std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    SearchServer(const std::string& stop_words_text, std::shared_ptr<const TextAnalyzer> analyzer,
+                 std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
+    // The copy allocates from the same upstream resource as other
+    SearchServer(const SearchServer& other);
+    SearchServer& operator=(const SearchServer&) = delete;
+
+    // Query words are optional, -word excludes documents and +word is required: once a
+    // query has required words, only documents containing all of them are scored
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
@@ -39,11 +87,40 @@ public:
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query) const;
 
+    // Run sequentially or in parallel depending on the total posting length of the
+    // query terms, the calibrated cost model and the current load. The model is
+    // calibrated by the first adaptive call anywhere, which then takes tens of
+    // milliseconds longer; call GetAdaptiveCostModel() at startup to avoid that.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const AdaptivePolicy&, std::string_view raw_query) const;
+
+    // Conjunctive mode: every plus word is required, as if written +word
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsAllTerms(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsAllTerms(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocumentsAllTerms(std::string_view raw_query) const;
+
+    // Search-after pagination: returns up to page_size documents ranked strictly after
+    // cursor, scoring documents one at a time so memory stays O(page_size) at any depth,
+    // plus one entry per matched document group once groups are in use.
+    // Paging relies on the (relevance, rating, id) key alone; if the index changed since the
+    // cursor was issued, the page is still returned with index_changed set.
+    template <typename DocumentPredicate>
+    SearchPage FindTopDocumentsAfter(std::string_view raw_query, const SearchCursor& cursor, size_t page_size,
+                                     DocumentPredicate document_predicate) const;
+    SearchPage FindTopDocumentsAfter(std::string_view raw_query, const SearchCursor& cursor, size_t page_size,
+                                     DocumentStatus status) const;
+    SearchPage FindTopDocumentsAfter(std::string_view raw_query, const SearchCursor& cursor, size_t page_size) const;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
     void RemoveDocument(int document_id);
+    // Parallel only for documents with enough words to pay for the thread handoff
+    void RemoveDocument(const AdaptivePolicy&, int document_id);
 
     template <typename ExecutionPolicy>
     std::tuple<std::vector<std::string_view>, DocumentStatus>
@@ -53,48 +130,120 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const st
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query, int document_id) const;
 
+    // Parses raw_query once and matches it against every document; the parallel
+    // version splits the documents, not the query words, between threads
+    MatchedDocuments MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+    MatchedDocuments MatchDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    MatchedDocuments MatchDocuments(const std::execution::parallel_policy&, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    // Words of the document in lexicographic order, without copying or allocating
+    WordFrequencies GetWordFrequenciesView(int document_id) const;
+    // Terms AddDocument would index for document, with repeats and without stop words.
+    // Views point into document or storage. Throws std::invalid_argument on invalid words.
+    std::vector<std::string_view> GetDocumentTerms(std::string_view document, AnalyzedText& storage) const;
+    // Compatibility wrapper over GetWordFrequenciesView; the map is reused per thread
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // Documents sharing a group are collapsed by FindTopDocuments to the best ranked
+    // one, and by FindTopDocumentsAfter to the best ranked one over all pages. Every
+    // document starts in its own group, equal to its id. group_id must be the id of a
+    // document; removing that document renames the group after its smallest member.
+    void SetDocumentGroup(int document_id, int group_id);
+    int GetDocumentGroup(int document_id) const;
+
     int GetDocumentCount() const;
+    bool HasDocument(int document_id) const;
+    // Incremented by every successful AddDocument and RemoveDocument
+    uint64_t GetGeneration() const;
+
+    MemoryUsage GetMemoryUsage() const;
 
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    std::pmr::set<int>::const_iterator begin() const;
+    std::pmr::set<int>::const_iterator end() const;
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        int group_id;
     };
 
-    struct QueryWord {
-        std::string_view data;
-        bool is_minus;
-        bool is_stop;
+    struct Query : QueryWords {
+        // Owns the words when an analyzer rewrote them; heap-allocated so views survive moves
+        std::unique_ptr<AnalyzedText> analyzed_words;
     };
 
-    struct Query {
+    // Query words that exist in the index, as views of the dictionary keys
+    struct ResolvedQuery {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<std::string_view> required_words;
+        // A required word is in no document, so nothing matches
+        bool has_missing_required_word = false;
+    };
+
+    // Deliberately not allocator-aware, so postings are charged to postings_resource_
+    // instead of inheriting the dictionary's allocator
+    struct PostingList {
+        std::pmr::map<int, double> document_freqs;
     };
 
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string, double, std::less<>>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
+    CountingMemoryResource stop_words_resource_;
+    CountingMemoryResource dictionary_resource_;
+    CountingMemoryResource postings_resource_;
+    CountingMemoryResource forward_index_resource_;
+    CountingMemoryResource metadata_resource_;
 
-    bool IsStopWord(std::string_view word) const;
-    static bool IsValidWord(std::string_view word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    StopWordSet stop_words_;
+    std::pmr::map<std::pmr::string, PostingList, std::less<>> word_to_document_freqs_;
+    // Sorted by word; the views point into word_to_document_freqs_ keys
+    std::pmr::map<int, std::pmr::vector<WordFrequency>> document_to_word_freqs_;
+    std::pmr::map<int, DocumentData> documents_;
+    std::pmr::set<int> document_ids_;
+    uint64_t generation_ = 0;
+    // Set once any document joins another's group; until then no collapsing is done
+    bool has_document_groups_ = false;
+    // Other documents of each group that has any, by group id
+    std::pmr::map<int, std::pmr::set<int>> group_followers_;
+    std::shared_ptr<const TextAnalyzer> analyzer_;
 
-    static int ComputeAverageRating(const std::vector<int>& ratings);
     double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    // Keeps the first document of every group among ranked documents, up to MAX_RESULT_DOCUMENT_COUNT
+    void CollapseDocumentGroups(std::vector<Document>& documents) const;
+    // Whether the group of the document has other members
+    bool IsInSharedGroup(int document_id, const DocumentData& document_data) const;
+    // Takes the document off the followers of its group, if it is not the group's own id
+    void RemoveGroupFollower(int document_id);
+    // Hands the group named after a removed document over to its smallest follower,
+    // so that a document later added with the same id does not join the group
+    void PromoteGroupFollower(int document_id);
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // Work estimate for the adaptive policy: postings of all plus and minus words
+    size_t CountQueryPostings(const Query& query) const;
     Query ParseQuerySeq(const std::string_view text) const;
-    Query ParseQueryPar(const std::string_view text) const;
+    ResolvedQuery ResolveQuery(const Query& query) const;
+    static size_t MatchResolvedQuery(const ResolvedQuery& query, const std::pmr::vector<WordFrequency>& word_freqs,
+                                     std::string_view* matched_words);
+
+    template <typename ExecutionPolicy>
+    MatchedDocuments MatchDocumentsImpl(ExecutionPolicy&& policy, std::string_view raw_query,
+                                        const std::vector<int>& document_ids) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsForQuery(ExecutionPolicy&& policy, const Query& query,
+                                                   DocumentPredicate document_predicate) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+
+    // Queries with required words: leapfrog intersection of their posting lists, shortest
+    // first, with minus words excluded in the same pass. Optional words are only looked
+    // up for the documents that survive. Always sequential: the work is the shortest list.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindRequiredDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    // Moves current to the first posting at or after document_id; postings are sought in
+    // ascending document order, so nearby targets are reached by stepping
+    static void SeekPosting(const std::pmr::map<int, double>& postings, std::pmr::map<int, double>::const_iterator& current,
+                            int document_id);
     
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const;
@@ -104,46 +253,88 @@ private:
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words) {
+SearchServer::SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* resource)
+    : SearchServer(stop_words, std::shared_ptr<const TextAnalyzer>{}, resource) {
+}
+
+template <typename StringContainer>
+SearchServer::SearchServer(const StringContainer& stop_words, std::shared_ptr<const TextAnalyzer> analyzer,
+                           std::pmr::memory_resource* resource)
+    : stop_words_resource_(resource)
+    , dictionary_resource_(resource)
+    , postings_resource_(resource)
+    , forward_index_resource_(resource)
+    , metadata_resource_(resource)
+    , stop_words_(&stop_words_resource_)
+    , word_to_document_freqs_(&dictionary_resource_)
+    , document_to_word_freqs_(&forward_index_resource_)
+    , documents_(&metadata_resource_)
+    , document_ids_(&metadata_resource_)
+    , group_followers_(&metadata_resource_)
+    , analyzer_(std::move(analyzer)) {
     using namespace std::string_literals;
+    std::vector<std::string_view> words;
+    AnalyzedText analyzed_words;
     for (std::string_view word : stop_words) {
         if (word.empty()) {
             continue;
         }
 
-        if (std::any_of(word.cbegin(), word.cend(), [](const char c) {return c >= '\0' && c < ' ';})) {
+        if (!IsValidWord(word)) {
             throw std::invalid_argument("Step words mustn't include special characters"s);
         }
 
-        stop_words_.insert(std::string(word));
+        if (analyzer_) {
+            analyzer_->Analyze(word, analyzed_words);
+        } else {
+            words.push_back(word);
+        }
+    }
+    for (size_t i = 0; i < analyzed_words.size(); ++i) {
+        words.push_back(analyzed_words[i]);
     }
+    stop_words_ = StopWordSet(words, &stop_words_resource_);
 }
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
     constexpr size_t KEY_COUNT = 100;
     ConcurrentMap<int, double> document_to_relevance(KEY_COUNT);
-    for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&](const auto& word){
-        if (word_to_document_freqs_.count(std::string(word)) != 0) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+    SEARCH_STATS_ONLY(std::atomic<uint64_t> postings_visited{0};)
+    {
+        // Workers run on foreign threads, so the whole parallel phase is charged to the caller;
+        // their allocations are not counted
+        SEARCH_STATS_STAGE(POSTING_TRAVERSAL);
+        for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&](const auto& word){
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings != word_to_document_freqs_.end()) {
+                SEARCH_STATS_ONLY(postings_visited.fetch_add(postings->second.document_freqs.size(), std::memory_order_relaxed);)
+                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                for (const auto [document_id, term_freq] : postings->second.document_freqs) {
+                    const auto& document_data = documents_.at(document_id);
+                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+                    }
                 }
             }
-        }    
-    });
-    for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), 
-        [&](const auto& word){
-            if (word_to_document_freqs_.count(std::string(word)) != 0) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-            document_to_relevance.Erase(document_id);
+        });
+    }
+    {
+        SEARCH_STATS_STAGE(MINUS_EXCLUSION);
+        for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
+            [&](const auto& word){
+                const auto postings = word_to_document_freqs_.find(word);
+                if (postings != word_to_document_freqs_.end()) {
+                    for (const auto [document_id, _] : postings->second.document_freqs) {
+                document_to_relevance.Erase(document_id);
+                    }
                 }
             }
-        }
-    );
+        );
+    }
+    SEARCH_STATS_COUNT(POSTINGS_VISITED, postings_visited.load(std::memory_order_relaxed));
     auto OrdinaryMap = document_to_relevance.BuildOrdinaryMap();
+    SEARCH_STATS_COUNT(DOCUMENTS_SCORED, OrdinaryMap.size());
     std::vector<Document> matched_documents;
     for (const auto [document_id, relevance] : OrdinaryMap) {
         matched_documents.push_back(
@@ -161,25 +352,43 @@ template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
     std::map<int, double> document_to_relevance;
     for (const auto& word : query.plus_words) {
-        if (word_to_document_freqs_.count(std::string(word)) == 0) {
-            continue;
+        auto postings = word_to_document_freqs_.end();
+        double inverse_document_freq = 0.0;
+        {
+            SEARCH_STATS_STAGE(TERM_LOOKUP);
+            postings = word_to_document_freqs_.find(word);
+            if (postings == word_to_document_freqs_.end()) {
+                continue;
+            }
+            inverse_document_freq = ComputeWordInverseDocumentFreq(word);
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
+        SEARCH_STATS_STAGE(POSTING_TRAVERSAL);
+        SEARCH_STATS_COUNT(POSTINGS_VISITED, postings->second.document_freqs.size());
+        for (const auto [document_id, term_freq] : postings->second.document_freqs) {
             const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+            bool is_accepted;
+            {
+                SEARCH_STATS_SAMPLED_STAGE(PREDICATE_FILTER);
+                is_accepted = document_predicate(document_id, document_data.status, document_data.rating);
+            }
+            if (is_accepted) {
                 document_to_relevance[document_id] += term_freq * inverse_document_freq;
             }
         }
     }
-    for (const auto& word : query.minus_words) {
-        if (word_to_document_freqs_.count(std::string(word)) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-            document_to_relevance.erase(document_id);
+    {
+        SEARCH_STATS_STAGE(MINUS_EXCLUSION);
+        for (const auto& word : query.minus_words) {
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings == word_to_document_freqs_.end()) {
+                continue;
+            }
+            for (const auto [document_id, _] : postings->second.document_freqs) {
+                document_to_relevance.erase(document_id);
+            }
         }
     }
+    SEARCH_STATS_COUNT(DOCUMENTS_SCORED, document_to_relevance.size());
     std::vector<Document> matched_documents;
     for (const auto [document_id, relevance] : document_to_relevance) {
         matched_documents.push_back(
@@ -189,20 +398,126 @@ std::vector<Document> SearchServer::FindAllDocuments(const Query& query, Documen
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuerySeq(raw_query);
-    auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
-    sort(std::execution::par, matched_documents.begin(), matched_documents.end(),
+std::vector<Document> SearchServer::FindRequiredDocuments(const Query& query, DocumentPredicate document_predicate) const {
+    using PostingIterator = std::pmr::map<int, double>::const_iterator;
+    struct Term {
+        const std::pmr::map<int, double>* postings;
+        PostingIterator current;
+        double inverse_document_freq;
+        bool is_required;
+    };
+    std::vector<Term> plus_terms;
+    std::vector<Term*> required_terms;
+    std::vector<Term> minus_terms;
+    {
+        SEARCH_STATS_STAGE(TERM_LOOKUP);
+        plus_terms.reserve(query.plus_words.size());
+        for (const auto& word : query.plus_words) {
+            const bool is_required = std::binary_search(query.required_words.begin(), query.required_words.end(), word);
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings == word_to_document_freqs_.end()) {
+                if (is_required) {
+                    return {};
+                }
+                continue;
+            }
+            const auto& document_freqs = postings->second.document_freqs;
+            plus_terms.push_back({&document_freqs, document_freqs.begin(), ComputeWordInverseDocumentFreq(word), is_required});
+            if (is_required) {
+                required_terms.push_back(&plus_terms.back());
+            }
+        }
+        for (const auto& word : query.minus_words) {
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings != word_to_document_freqs_.end()) {
+                const auto& document_freqs = postings->second.document_freqs;
+                minus_terms.push_back({&document_freqs, document_freqs.begin(), 0.0, false});
+            }
+        }
+    }
+    std::sort(required_terms.begin(), required_terms.end(), [](const Term* lhs, const Term* rhs) {
+        return lhs->postings->size() < rhs->postings->size();
+    });
+
+    SEARCH_STATS_STAGE(POSTING_TRAVERSAL);
+    SEARCH_STATS_COUNT(POSTINGS_VISITED, required_terms.front()->postings->size());
+    std::vector<Document> matched_documents;
+    Term& lead = *required_terms.front();
+    while (lead.current != lead.postings->end()) {
+        const int document_id = lead.current->first;
+        // A longer list that overshoots the candidate moves the lead to where it stopped
+        bool is_candidate = true;
+        bool is_exhausted = false;
+        for (size_t i = 1; i < required_terms.size() && is_candidate; ++i) {
+            Term& term = *required_terms[i];
+            SeekPosting(*term.postings, term.current, document_id);
+            if (term.current == term.postings->end()) {
+                is_exhausted = true;
+                break;
+            }
+            if (term.current->first != document_id) {
+                SeekPosting(*lead.postings, lead.current, term.current->first);
+                is_candidate = false;
+            }
+        }
+        if (is_exhausted) {
+            break;
+        }
+        if (!is_candidate) {
+            continue;
+        }
+        bool is_excluded = false;
+        for (Term& term : minus_terms) {
+            SeekPosting(*term.postings, term.current, document_id);
+            is_excluded = is_excluded || (term.current != term.postings->end() && term.current->first == document_id);
+        }
+        const auto& document_data = documents_.at(document_id);
+        if (!is_excluded && document_predicate(document_id, document_data.status, document_data.rating)) {
+            // Terms are summed in plus word order, as in FindAllDocuments, so relevances are identical
+            double relevance = 0.0;
+            for (Term& term : plus_terms) {
+                if (!term.is_required) {
+                    SeekPosting(*term.postings, term.current, document_id);
+                }
+                if (term.current != term.postings->end() && term.current->first == document_id) {
+                    relevance += term.current->second * term.inverse_document_freq;
+                }
+            }
+            matched_documents.push_back({document_id, relevance, document_data.rating});
+        }
+        ++lead.current;
+    }
+    SEARCH_STATS_COUNT(DOCUMENTS_SCORED, matched_documents.size());
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(ExecutionPolicy&& policy, const Query& query,
+                                                            DocumentPredicate document_predicate) const {
+    auto matched_documents = query.required_words.empty()
+        ? FindAllDocuments(policy, query, document_predicate)
+        : FindRequiredDocuments(query, document_predicate);
+    SEARCH_STATS_STAGE(TOP_K_SORT);
+    sort(policy, matched_documents.begin(), matched_documents.end(),
          [](const Document& lhs, const Document& rhs) {
              return lhs.relevance > rhs.relevance
                  || (std::abs(lhs.relevance - rhs.relevance) < 1e-6 && lhs.rating > rhs.rating);
          });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+    if (has_document_groups_) {
+        CollapseDocumentGroups(matched_documents);
+    } else if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
         matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
     }
     return matched_documents;
 }
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    SEARCH_STATS_QUERY();
+    const auto query = ParseQuerySeq(raw_query);
+    return FindTopDocumentsForQuery(std::execution::par, query, document_predicate);
+}
+
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
     return SearchServer::FindTopDocuments(raw_query, document_predicate);
@@ -210,17 +525,163 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::seque
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
+    SEARCH_STATS_QUERY();
     const auto query = ParseQuerySeq(raw_query);
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-    sort(matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-             return lhs.relevance > rhs.relevance
-                 || (std::abs(lhs.relevance - rhs.relevance) < 1e-6 && lhs.rating > rhs.rating);
-         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    return FindTopDocumentsForQuery(std::execution::seq, query, document_predicate);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const AdaptivePolicy&, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    SEARCH_STATS_QUERY();
+    const auto query = ParseQuerySeq(raw_query);
+    const AdaptiveLoadGuard load;
+    const ExecutionPath path = SelectExecutionPath(AdaptiveOperation::SEARCH, CountQueryPostings(query), load.GetInFlight());
+    RecordExecutionPath(path);
+    if (path == ExecutionPath::PARALLEL) {
+        return FindTopDocumentsForQuery(std::execution::par, query, document_predicate);
     }
-    return matched_documents;
+    return FindTopDocumentsForQuery(std::execution::seq, query, document_predicate);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsAllTerms(std::string_view raw_query, DocumentPredicate document_predicate) const {
+    SEARCH_STATS_QUERY();
+    auto query = ParseQuerySeq(raw_query);
+    query.required_words = query.plus_words;
+    return FindTopDocumentsForQuery(std::execution::seq, query, document_predicate);
+}
+
+template <typename DocumentPredicate>
+SearchPage SearchServer::FindTopDocumentsAfter(std::string_view raw_query, const SearchCursor& cursor, size_t page_size,
+                                               DocumentPredicate document_predicate) const {
+    using namespace std::string_literals;
+    if (page_size == 0) {
+        throw std::invalid_argument("Page size must be positive"s);
+    }
+    SEARCH_STATS_QUERY();
+    const auto query = ParseQuerySeq(raw_query);
+
+    using PostingIterator = std::pmr::map<int, double>::const_iterator;
+    struct Term {
+        PostingIterator current;
+        PostingIterator end;
+        double inverse_document_freq;
+        bool is_required;
+    };
+    std::vector<Term> plus_terms;
+    std::vector<Term> minus_terms;
+    {
+        SEARCH_STATS_STAGE(TERM_LOOKUP);
+        for (const auto& word : query.plus_words) {
+            const bool is_required = std::binary_search(query.required_words.begin(), query.required_words.end(), word);
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings != word_to_document_freqs_.end()) {
+                plus_terms.push_back({postings->second.document_freqs.begin(), postings->second.document_freqs.end(),
+                                      ComputeWordInverseDocumentFreq(word), is_required});
+            } else if (is_required) {
+                plus_terms.clear();
+                break;
+            }
+        }
+        for (const auto& word : query.minus_words) {
+            const auto postings = word_to_document_freqs_.find(word);
+            if (postings != word_to_document_freqs_.end()) {
+                minus_terms.push_back({postings->second.document_freqs.begin(), postings->second.document_freqs.end(), 0.0, false});
+            }
+        }
+    }
+    const size_t required_term_count = std::count_if(plus_terms.begin(), plus_terms.end(), [](const Term& term) {
+        return term.is_required;
+    });
+    SEARCH_STATS_ONLY(for (const Term& term : plus_terms) {
+        SEARCH_STATS_COUNT(POSTINGS_VISITED, std::distance(term.current, term.end));
+    })
+
+    // Max-heap on rank: the front is the worst document kept so far
+    std::vector<Document> page;
+    page.reserve(page_size + 1);
+    size_t documents_after_cursor = 0;
+    const auto offer = [&](const Document& document) {
+        if (!cursor.IsBegin() && !IsRankedBefore(cursor.GetLastDocument(), document)) {
+            return;
+        }
+        ++documents_after_cursor;
+        page.push_back(document);
+        std::push_heap(page.begin(), page.end(), IsRankedBefore);
+        if (page.size() > page_size) {
+            std::pop_heap(page.begin(), page.end(), IsRankedBefore);
+            page.pop_back();
+        }
+    };
+    // Only the best member of a shared group is ranked, so each group shows up once over
+    // all pages, where FindTopDocuments would show it. Costs one entry per matched group.
+    std::map<int, Document> group_best_documents;
+    {
+        // Minus words are skipped over in the same merge, so their time stays in this stage
+        SEARCH_STATS_STAGE(POSTING_TRAVERSAL);
+        for (;;) {
+            int document_id = -1;
+            for (const Term& term : plus_terms) {
+                if (term.current != term.end && (document_id < 0 || term.current->first < document_id)) {
+                    document_id = term.current->first;
+                }
+            }
+            if (document_id < 0) {
+                break;
+            }
+            // Terms are summed in the same order as FindAllDocuments, so relevances are identical
+            double relevance = 0.0;
+            size_t required_matches = 0;
+            for (Term& term : plus_terms) {
+                if (term.current != term.end && term.current->first == document_id) {
+                    relevance += term.current->second * term.inverse_document_freq;
+                    required_matches += term.is_required;
+                    ++term.current;
+                }
+            }
+            bool is_excluded = false;
+            for (Term& term : minus_terms) {
+                while (term.current != term.end && term.current->first < document_id) {
+                    ++term.current;
+                }
+                is_excluded = is_excluded || (term.current != term.end && term.current->first == document_id);
+            }
+            if (is_excluded || required_matches < required_term_count) {
+                continue;
+            }
+            const auto& document_data = documents_.at(document_id);
+            bool is_accepted;
+            {
+                SEARCH_STATS_SAMPLED_STAGE(PREDICATE_FILTER);
+                is_accepted = document_predicate(document_id, document_data.status, document_data.rating);
+            }
+            if (!is_accepted) {
+                continue;
+            }
+            SEARCH_STATS_COUNT(DOCUMENTS_SCORED, 1);
+            const Document document(document_id, relevance, document_data.rating);
+            if (has_document_groups_ && IsInSharedGroup(document_id, document_data)) {
+                const auto [best, is_new] = group_best_documents.emplace(document_data.group_id, document);
+                if (!is_new && IsRankedBefore(document, best->second)) {
+                    best->second = document;
+                }
+                continue;
+            }
+            offer(document);
+        }
+        for (const auto& [_, document] : group_best_documents) {
+            offer(document);
+        }
+    }
+
+    SEARCH_STATS_STAGE(TOP_K_SORT);
+    std::sort_heap(page.begin(), page.end(), IsRankedBefore);
+    SearchPage result;
+    result.has_more = documents_after_cursor > page.size();
+    result.index_changed = !cursor.IsBegin() && cursor.GetGeneration() != generation_;
+    result.next = page.empty() ? cursor : SearchCursor(generation_, page.back());
+    result.documents = std::move(page);
+    return result;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, std::string_view document,
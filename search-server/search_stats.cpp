@@ -0,0 +1,299 @@
+#include "search_stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct StatsRegistry {
+    atomic<uint64_t> queries{0};
+    array<Histogram, SEARCH_STAGE_COUNT> stage_ns;
+    array<Histogram, SEARCH_COUNTER_COUNT> counters;
+};
+
+StatsRegistry& GetRegistry() {
+    static StatsRegistry registry;
+    return registry;
+}
+
+// Constant-initialized so that it is safe to touch from operator new
+struct ThreadQueryStats {
+    int depth = 0;
+    int suspend_depth = 0;
+    int current_stage = -1;
+    Clock::time_point mark;
+    uint32_t sample_tick = 0;
+    uint64_t allocations_at_start = 0;
+    uint64_t stage_ns[SEARCH_STAGE_COUNT] = {};
+    uint64_t counters[SEARCH_COUNTER_COUNT] = {};
+};
+
+thread_local ThreadQueryStats thread_stats;
+thread_local uint64_t thread_allocations = 0;
+
+size_t BucketOf(uint64_t value) {
+    size_t bucket = 0;
+    while (value != 0 && bucket + 1 < Histogram::BUCKET_COUNT) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void ChargeCurrentStage(Clock::time_point now) {
+    if (thread_stats.current_stage >= 0) {
+        thread_stats.stage_ns[thread_stats.current_stage] +=
+            chrono::duration_cast<chrono::nanoseconds>(now - thread_stats.mark).count();
+    }
+    thread_stats.mark = now;
+}
+
+// Cost of one clock read, subtracted from sampled durations that are close to it
+uint64_t GetClockOverheadNs() {
+    static const uint64_t overhead_ns = [] {
+        auto min_ns = numeric_limits<int64_t>::max();
+        for (int i = 0; i < 1000; ++i) {
+            const auto start = Clock::now();
+            min_ns = min<int64_t>(min_ns, chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        return static_cast<uint64_t>(min_ns);
+    }();
+    return overhead_ns;
+}
+
+void PrintHistogram(ostream& out, const char* name, const char* label, const Histogram::Snapshot& histogram,
+                    double scale) {
+    size_t last = 0;
+    for (size_t i = 0; i < Histogram::BUCKET_COUNT; ++i) {
+        if (histogram.buckets[i] != 0) {
+            last = i;
+        }
+    }
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= last; ++i) {
+        cumulative += histogram.buckets[i];
+        out << name << "_bucket{"s << label << "le=\""s << Histogram::BucketUpperBound(i) * scale << "\"} "s
+            << cumulative << '\n';
+    }
+    out << name << "_bucket{"s << label << "le=\"+Inf\"} "s << histogram.count << '\n';
+    string plain_label = label;
+    if (!plain_label.empty()) {
+        plain_label.pop_back();
+        plain_label = "{"s + plain_label + "}"s;
+    }
+    out << name << "_sum"s << plain_label << ' ' << histogram.sum * scale << '\n';
+    out << name << "_count"s << plain_label << ' ' << histogram.count << '\n';
+}
+
+} // namespace
+
+uint64_t Histogram::BucketUpperBound(size_t bucket) {
+    return bucket == 0 ? 0 : (uint64_t{1} << bucket) - 1;
+}
+
+void Histogram::Record(uint64_t value) {
+    buckets_[BucketOf(value)].fetch_add(1, memory_order_relaxed);
+    count_.fetch_add(1, memory_order_relaxed);
+    sum_.fetch_add(value, memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::GetSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        snapshot.buckets[i] = buckets_[i].load(memory_order_relaxed);
+    }
+    snapshot.count = count_.load(memory_order_relaxed);
+    snapshot.sum = sum_.load(memory_order_relaxed);
+    return snapshot;
+}
+
+void Histogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    count_.store(0, memory_order_relaxed);
+    sum_.store(0, memory_order_relaxed);
+}
+
+uint64_t Histogram::Snapshot::Percentile(double fraction) const {
+    uint64_t total = 0;
+    for (const uint64_t bucket : buckets) {
+        total += bucket;
+    }
+    const auto rank = static_cast<uint64_t>(fraction * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return BucketUpperBound(i);
+        }
+    }
+    return 0;
+}
+
+SearchStatsSnapshot GetSearchStats() {
+    const auto& registry = GetRegistry();
+    SearchStatsSnapshot snapshot;
+    snapshot.queries = registry.queries.load(memory_order_relaxed);
+    for (size_t i = 0; i < SEARCH_STAGE_COUNT; ++i) {
+        snapshot.stage_ns[i] = registry.stage_ns[i].GetSnapshot();
+    }
+    for (size_t i = 0; i < SEARCH_COUNTER_COUNT; ++i) {
+        snapshot.counters[i] = registry.counters[i].GetSnapshot();
+    }
+    return snapshot;
+}
+
+void ResetSearchStats() {
+    auto& registry = GetRegistry();
+    registry.queries.store(0, memory_order_relaxed);
+    for (auto& histogram : registry.stage_ns) {
+        histogram.Reset();
+    }
+    for (auto& histogram : registry.counters) {
+        histogram.Reset();
+    }
+}
+
+const char* GetSearchStageName(SearchStage stage) {
+    static const char* const names[SEARCH_STAGE_COUNT] = {
+        "parse", "term_lookup", "posting_traversal", "predicate_filter", "minus_exclusion", "top_k_sort",
+    };
+    return names[static_cast<size_t>(stage)];
+}
+
+const char* GetSearchCounterName(SearchCounter counter) {
+    static const char* const names[SEARCH_COUNTER_COUNT] = {
+        "postings_visited", "documents_scored", "allocations",
+    };
+    return names[static_cast<size_t>(counter)];
+}
+
+void PrintSearchStatsPrometheus(ostream& out, const SearchStatsSnapshot& stats) {
+    out << "# TYPE search_server_queries_total counter\n"s;
+    out << "search_server_queries_total "s << stats.queries << '\n';
+
+    out << "# TYPE search_server_stage_duration_seconds histogram\n"s;
+    for (size_t i = 0; i < SEARCH_STAGE_COUNT; ++i) {
+        const string label = "stage=\""s + GetSearchStageName(static_cast<SearchStage>(i)) + "\","s;
+        PrintHistogram(out, "search_server_stage_duration_seconds", label.c_str(), stats.stage_ns[i], 1e-9);
+    }
+    for (size_t i = 0; i < SEARCH_COUNTER_COUNT; ++i) {
+        const string name = "search_server_query_"s + GetSearchCounterName(static_cast<SearchCounter>(i));
+        out << "# TYPE "s << name << " histogram\n"s;
+        PrintHistogram(out, name.c_str(), "", stats.counters[i], 1.0);
+    }
+}
+
+namespace search_stats_detail {
+
+QueryScope::QueryScope() {
+    if (thread_stats.depth++ != 0) {
+        return;
+    }
+    thread_stats.current_stage = -1;
+    thread_stats.mark = Clock::now();
+    thread_stats.allocations_at_start = thread_allocations;
+    for (auto& value : thread_stats.stage_ns) {
+        value = 0;
+    }
+    for (auto& value : thread_stats.counters) {
+        value = 0;
+    }
+}
+
+QueryScope::~QueryScope() {
+    if (--thread_stats.depth != 0 || thread_stats.suspend_depth > 0) {
+        return;
+    }
+    thread_stats.counters[static_cast<size_t>(SearchCounter::ALLOCATIONS)] =
+        thread_allocations - thread_stats.allocations_at_start;
+    auto& registry = GetRegistry();
+    registry.queries.fetch_add(1, memory_order_relaxed);
+    for (size_t i = 0; i < SEARCH_STAGE_COUNT; ++i) {
+        registry.stage_ns[i].Record(thread_stats.stage_ns[i]);
+    }
+    for (size_t i = 0; i < SEARCH_COUNTER_COUNT; ++i) {
+        registry.counters[i].Record(thread_stats.counters[i]);
+    }
+}
+
+StageScope::StageScope(SearchStage stage)
+    : previous_stage_(thread_stats.current_stage)
+    , active_(thread_stats.depth > 0) {
+    if (active_) {
+        ChargeCurrentStage(Clock::now());
+        thread_stats.current_stage = static_cast<int>(stage);
+    }
+}
+
+StageScope::~StageScope() {
+    if (active_) {
+        ChargeCurrentStage(Clock::now());
+        thread_stats.current_stage = previous_stage_;
+    }
+}
+
+SampledStageScope::SampledStageScope(SearchStage stage)
+    : stage_(-1) {
+    if (thread_stats.depth > 0 && ++thread_stats.sample_tick % STAGE_SAMPLE_PERIOD == 0) {
+        stage_ = static_cast<int>(stage);
+        start_ = Clock::now();
+    }
+}
+
+SampledStageScope::~SampledStageScope() {
+    if (stage_ < 0) {
+        return;
+    }
+    const auto now = Clock::now();
+    ChargeCurrentStage(now);
+    const auto sample_ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(now - start_).count());
+    const uint64_t estimate_ns = (sample_ns - min(sample_ns, GetClockOverheadNs())) * STAGE_SAMPLE_PERIOD;
+    thread_stats.stage_ns[stage_] += estimate_ns;
+    if (thread_stats.current_stage >= 0) {
+        uint64_t& enclosing_ns = thread_stats.stage_ns[thread_stats.current_stage];
+        enclosing_ns -= min(enclosing_ns, estimate_ns);
+    }
+}
+
+SuspendScope::SuspendScope() {
+    ++thread_stats.suspend_depth;
+}
+
+SuspendScope::~SuspendScope() {
+    --thread_stats.suspend_depth;
+}
+
+void Count(SearchCounter counter, uint64_t value) {
+    if (thread_stats.depth > 0) {
+        thread_stats.counters[static_cast<size_t>(counter)] += value;
+    }
+}
+
+} // namespace search_stats_detail
+
+#ifdef SEARCH_SERVER_STATS
+// Allocation counting needs a replaceable operator new, so it exists only in instrumented builds
+void* operator new(size_t size) {
+    ++thread_allocations;
+    if (void* pointer = malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+#endif
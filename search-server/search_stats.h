@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+// Hot-path instrumentation of SearchServer. The hooks below are compiled in only
+// when SEARCH_SERVER_STATS is defined; otherwise they expand to nothing and the
+// snapshot API reports zeros. Covers FindTopDocuments, FindTopDocumentsAllTerms and
+// FindTopDocumentsAfter; MatchDocument(s) walk the forward index rather than postings
+// and are left out so that they do not blur the search histograms.
+
+enum class SearchStage {
+    PARSE,
+    TERM_LOOKUP,
+    POSTING_TRAVERSAL,
+    PREDICATE_FILTER,
+    MINUS_EXCLUSION,
+    TOP_K_SORT,
+};
+
+enum class SearchCounter {
+    POSTINGS_VISITED,
+    DOCUMENTS_SCORED,
+    // Counted per thread: allocations made by TBB workers on par paths are not
+    // attributed to the query, so par queries are undercounted
+    ALLOCATIONS,
+};
+
+constexpr size_t SEARCH_STAGE_COUNT = 6;
+constexpr size_t SEARCH_COUNTER_COUNT = 3;
+
+// Power-of-two buckets: bucket 0 holds zeros, bucket i holds values in [2^(i-1), 2^i)
+class Histogram {
+public:
+    static constexpr size_t BUCKET_COUNT = 64;
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKET_COUNT> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        // Upper bound of the bucket holding the requested quantile
+        uint64_t Percentile(double fraction) const;
+    };
+
+    void Record(uint64_t value);
+    Snapshot GetSnapshot() const;
+    void Reset();
+
+    static uint64_t BucketUpperBound(size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+struct SearchStatsSnapshot {
+    uint64_t queries = 0;
+    // Exclusive time per stage and query, in nanoseconds
+    std::array<Histogram::Snapshot, SEARCH_STAGE_COUNT> stage_ns;
+    // Counter values per query
+    std::array<Histogram::Snapshot, SEARCH_COUNTER_COUNT> counters;
+};
+
+SearchStatsSnapshot GetSearchStats();
+void ResetSearchStats();
+void PrintSearchStatsPrometheus(std::ostream& out, const SearchStatsSnapshot& stats);
+
+const char* GetSearchStageName(SearchStage stage);
+const char* GetSearchCounterName(SearchCounter counter);
+
+namespace search_stats_detail {
+
+// Accumulates one query on the calling thread and flushes it on the outermost QueryScope exit
+class QueryScope {
+public:
+    QueryScope();
+    ~QueryScope();
+    QueryScope(const QueryScope&) = delete;
+    QueryScope& operator=(const QueryScope&) = delete;
+};
+
+// Attributes time to a stage exclusively: an inner stage pauses the enclosing one
+class StageScope {
+public:
+    explicit StageScope(SearchStage stage);
+    ~StageScope();
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    int previous_stage_;
+    bool active_;
+};
+
+// For stages too short to time on every call, such as one predicate call: times one
+// call in STAGE_SAMPLE_PERIOD and moves that duration times the period from the
+// enclosing stage to this one
+class SampledStageScope {
+public:
+    static constexpr uint32_t STAGE_SAMPLE_PERIOD = 64;
+
+    explicit SampledStageScope(SearchStage stage);
+    ~SampledStageScope();
+    SampledStageScope(const SampledStageScope&) = delete;
+    SampledStageScope& operator=(const SampledStageScope&) = delete;
+
+private:
+    // -1 when this call is not sampled
+    int stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Keeps queries finished on the calling thread out of the statistics, e.g. internal
+// calibration runs
+class SuspendScope {
+public:
+    SuspendScope();
+    ~SuspendScope();
+    SuspendScope(const SuspendScope&) = delete;
+    SuspendScope& operator=(const SuspendScope&) = delete;
+};
+
+void Count(SearchCounter counter, uint64_t value);
+
+} // namespace search_stats_detail
+
+#ifdef SEARCH_SERVER_STATS
+#define SEARCH_STATS_CONCAT_INTERNAL(X, Y) X##Y
+#define SEARCH_STATS_CONCAT(X, Y) SEARCH_STATS_CONCAT_INTERNAL(X, Y)
+#define SEARCH_STATS_QUERY() \
+    search_stats_detail::QueryScope SEARCH_STATS_CONCAT(search_stats_query_, __LINE__)
+#define SEARCH_STATS_STAGE(stage) \
+    search_stats_detail::StageScope SEARCH_STATS_CONCAT(search_stats_stage_, __LINE__)(SearchStage::stage)
+#define SEARCH_STATS_SAMPLED_STAGE(stage) \
+    search_stats_detail::SampledStageScope SEARCH_STATS_CONCAT(search_stats_stage_, __LINE__)(SearchStage::stage)
+#define SEARCH_STATS_SUSPEND() \
+    search_stats_detail::SuspendScope SEARCH_STATS_CONCAT(search_stats_suspend_, __LINE__)
+#define SEARCH_STATS_COUNT(counter, value) search_stats_detail::Count(SearchCounter::counter, (value))
+#define SEARCH_STATS_ONLY(...) __VA_ARGS__
+#else
+#define SEARCH_STATS_QUERY() static_cast<void>(0)
+#define SEARCH_STATS_STAGE(stage) static_cast<void>(0)
+#define SEARCH_STATS_SAMPLED_STAGE(stage) static_cast<void>(0)
+#define SEARCH_STATS_SUSPEND() static_cast<void>(0)
+#define SEARCH_STATS_COUNT(counter, value) static_cast<void>(0)
+#define SEARCH_STATS_ONLY(...)
+#endif
@@ -0,0 +1,593 @@
+#include "segmented_index.h"
+#include "query_parsing.h"
+#include "string_processing.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+
+// Merge output between two rate limiter checks
+const size_t RATE_LIMIT_CHUNK_SIZE = size_t{64} << 10;
+
+class RateLimiter {
+public:
+    using Clock = chrono::steady_clock;
+
+    explicit RateLimiter(double bytes_per_second)
+        : bytes_per_second_(bytes_per_second)
+        , next_free_(Clock::now()) {
+    }
+
+    // Books bytes just written; returns when the rate will have paid for them
+    Clock::time_point Acquire(size_t bytes) {
+        if (bytes_per_second_ <= 0 || bytes == 0) {
+            return next_free_;
+        }
+        next_free_ = max(next_free_, Clock::now())
+            + chrono::duration_cast<Clock::duration>(chrono::duration<double>(bytes / bytes_per_second_));
+        return next_free_;
+    }
+
+private:
+    double bytes_per_second_;
+    Clock::time_point next_free_;
+};
+
+} // namespace
+
+class SegmentedIndex::SegmentWriter {
+public:
+    SegmentWriter(vector<int> document_ids, vector<DocumentData> documents)
+        : segment_(make_shared<Segment>()) {
+        segment_->document_ids = move(document_ids);
+        segment_->documents = move(documents);
+        segment_->term_offsets.push_back(0);
+        segment_->posting_offsets.push_back(0);
+    }
+
+    // Terms must come in ascending order; postings may be in any order
+    void AddTerm(string_view term, vector<Posting>& postings) {
+        if (postings.empty()) {
+            return;
+        }
+        sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+            return lhs.document < rhs.document;
+        });
+        segment_->term_text.append(term);
+        segment_->term_offsets.push_back(static_cast<uint32_t>(segment_->term_text.size()));
+        segment_->postings.insert(segment_->postings.end(), postings.begin(), postings.end());
+        segment_->posting_offsets.push_back(static_cast<uint32_t>(segment_->postings.size()));
+    }
+
+    shared_ptr<Segment> Finish() {
+        Segment& segment = *segment_;
+        const size_t document_count = segment.document_ids.size();
+        const size_t term_count = segment.GetTermCount();
+        // Forward index by counting sort of the postings
+        segment.document_term_offsets.assign(document_count + 1, 0);
+        for (const Posting& posting : segment.postings) {
+            ++segment.document_term_offsets[posting.document + 1];
+        }
+        for (size_t document = 0; document < document_count; ++document) {
+            segment.document_term_offsets[document + 1] += segment.document_term_offsets[document];
+        }
+        segment.document_terms.resize(segment.postings.size());
+        vector<uint32_t> next(segment.document_term_offsets.begin(), segment.document_term_offsets.end() - 1);
+        for (uint32_t term = 0; term < term_count; ++term) {
+            for (uint32_t i = segment.posting_offsets[term]; i < segment.posting_offsets[term + 1]; ++i) {
+                segment.document_terms[next[segment.postings[i].document]++] = term;
+            }
+        }
+        const size_t word_count = (document_count + 63) / 64;
+        segment.deleted = make_unique<atomic<uint64_t>[]>(word_count);
+        for (size_t i = 0; i < word_count; ++i) {
+            segment.deleted[i].store(0, memory_order_relaxed);
+        }
+        segment.deleted_postings.assign(term_count, 0);
+        segment.term_text.shrink_to_fit();
+        segment.postings.shrink_to_fit();
+        return move(segment_);
+    }
+
+private:
+    shared_ptr<Segment> segment_;
+};
+
+size_t SegmentedIndex::Segment::GetTermCount() const {
+    return term_offsets.size() - 1;
+}
+
+string_view SegmentedIndex::Segment::GetTerm(uint32_t term) const {
+    return string_view(term_text).substr(term_offsets[term], term_offsets[term + 1] - term_offsets[term]);
+}
+
+uint32_t SegmentedIndex::Segment::FindTerm(string_view word) const {
+    uint32_t begin = 0;
+    uint32_t end = static_cast<uint32_t>(GetTermCount());
+    while (begin < end) {
+        const uint32_t middle = begin + (end - begin) / 2;
+        if (GetTerm(middle) < word) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin < GetTermCount() && GetTerm(begin) == word ? begin : static_cast<uint32_t>(GetTermCount());
+}
+
+bool SegmentedIndex::Segment::IsDeleted(uint32_t document) const {
+    return (deleted[document / 64].load(memory_order_relaxed) >> (document % 64)) & 1;
+}
+
+void SegmentedIndex::Segment::MarkDeleted(uint32_t document) {
+    deleted[document / 64].fetch_or(uint64_t{1} << (document % 64), memory_order_relaxed);
+    ++deleted_count;
+    for (uint32_t i = document_term_offsets[document]; i < document_term_offsets[document + 1]; ++i) {
+        ++deleted_postings[document_terms[i]];
+    }
+}
+
+size_t SegmentedIndex::Segment::GetLiveDocumentCount() const {
+    return document_ids.size() - deleted_count;
+}
+
+size_t SegmentedIndex::Segment::GetByteSize() const {
+    return document_ids.size() * (sizeof(int) + sizeof(DocumentData) + sizeof(uint32_t))
+        + term_text.size() + term_offsets.size() * sizeof(uint32_t) + posting_offsets.size() * sizeof(uint32_t)
+        + postings.size() * sizeof(Posting) + document_terms.size() * sizeof(uint32_t);
+}
+
+bool SegmentedIndex::Buffer::IsDeleted(uint32_t document) const {
+    return deleted[document];
+}
+
+size_t SegmentedIndex::Buffer::GetLiveDocumentCount() const {
+    return document_ids.size() - deleted_count;
+}
+
+SegmentedIndex::SegmentedIndex(string_view stop_words_text, SegmentedIndexOptions options,
+                               shared_ptr<const TextAnalyzer> analyzer)
+    : options_(options)
+    , analyzer_(move(analyzer)) {
+    if (options_.max_buffered_documents == 0 || options_.segments_per_tier < 2) {
+        throw invalid_argument("Segments must hold at least one document and tiers at least two segments"s);
+    }
+    vector<string_view> words;
+    AnalyzedText analyzed_words;
+    for (const string_view word : SplitIntoWords(stop_words_text)) {
+        if (!IsValidWord(word)) {
+            throw invalid_argument("Stop words mustn't include special characters"s);
+        }
+        if (analyzer_) {
+            analyzer_->Analyze(word, analyzed_words);
+        } else {
+            words.push_back(word);
+        }
+    }
+    for (size_t i = 0; i < analyzed_words.size(); ++i) {
+        words.push_back(analyzed_words[i]);
+    }
+    stop_words_ = StopWordSet(words);
+    merge_thread_ = thread([this] {
+        RunMergeThread();
+    });
+}
+
+SegmentedIndex::~SegmentedIndex() {
+    {
+        lock_guard lock(merge_mutex_);
+        is_stopping_ = true;
+    }
+    merge_cv_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedIndex::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    // Analysis needs no lock and is the bulk of the work
+    AnalyzedText storage;
+    auto words = SplitIntoWordsNoStop(document, stop_words_, analyzer_.get(), storage);
+    sort(words.begin(), words.end());
+    const DocumentData document_data{ComputeAverageRating(ratings), status};
+    const double inv_word_count = 1.0 / words.size();
+
+    bool is_flushed = false;
+    {
+        unique_lock lock(index_mutex_);
+        if (ContainsLiveDocument(document_id)) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        const auto position = static_cast<uint32_t>(buffer_.document_ids.size());
+        buffer_.document_ids.push_back(document_id);
+        buffer_.documents.push_back(document_data);
+        buffer_.deleted.push_back(false);
+        buffer_.positions.emplace(document_id, position);
+        auto& document_words = buffer_.document_words.emplace_back();
+        for (auto begin = words.begin(); begin != words.end();) {
+            const auto end = find_if(begin, words.end(), [begin](string_view word) { return word != *begin; });
+            auto postings = buffer_.postings.find(*begin);
+            if (postings == buffer_.postings.end()) {
+                postings = buffer_.postings.emplace(string(*begin), vector<Posting>()).first;
+            }
+            postings->second.push_back({position, (end - begin) * inv_word_count});
+            document_words.push_back(postings->first);
+            begin = end;
+        }
+        ++live_document_count_;
+        if (buffer_.document_ids.size() >= options_.max_buffered_documents) {
+            FlushBuffer();
+            is_flushed = true;
+        }
+    }
+    if (is_flushed) {
+        RequestMerge();
+    }
+}
+
+void SegmentedIndex::RemoveDocument(int document_id) {
+    unique_lock lock(index_mutex_);
+    if (const auto position = buffer_.positions.find(document_id); position != buffer_.positions.end()) {
+        const uint32_t document = position->second;
+        for (const string_view word : buffer_.document_words[document]) {
+            const auto postings = buffer_.postings.find(word);
+            auto& document_postings = postings->second;
+            document_postings.erase(find_if(document_postings.begin(), document_postings.end(),
+                                            [document](const Posting& posting) { return posting.document == document; }));
+            if (document_postings.empty()) {
+                buffer_.postings.erase(postings);
+            }
+        }
+        buffer_.document_words[document].clear();
+        buffer_.deleted[document] = true;
+        ++buffer_.deleted_count;
+        buffer_.positions.erase(position);
+        --live_document_count_;
+        return;
+    }
+    for (const auto& segment : segments_) {
+        const auto id = lower_bound(segment->document_ids.begin(), segment->document_ids.end(), document_id);
+        if (id != segment->document_ids.end() && *id == document_id) {
+            const auto document = static_cast<uint32_t>(id - segment->document_ids.begin());
+            if (!segment->IsDeleted(document)) {
+                segment->MarkDeleted(document);
+                --live_document_count_;
+                return;
+            }
+        }
+    }
+}
+
+vector<Document> SegmentedIndex::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+
+vector<Document> SegmentedIndex::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> SegmentedIndex::FindTopDocuments(const execution::parallel_policy&, string_view raw_query,
+                                                  DocumentStatus status) const {
+    return FindTopDocuments(execution::par, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    });
+}
+
+vector<Document> SegmentedIndex::FindTopDocuments(const execution::parallel_policy&, string_view raw_query) const {
+    return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
+}
+
+int SegmentedIndex::GetDocumentCount() const {
+    shared_lock lock(index_mutex_);
+    return static_cast<int>(live_document_count_);
+}
+
+SegmentedIndexStats SegmentedIndex::GetStats() const {
+    SegmentedIndexStats stats;
+    {
+        shared_lock lock(index_mutex_);
+        stats.segment_count = segments_.size();
+        stats.buffered_documents = buffer_.GetLiveDocumentCount();
+        for (const auto& segment : segments_) {
+            stats.deleted_documents += segment->deleted_count;
+        }
+    }
+    stats.flush_count = flush_count_.load(memory_order_relaxed);
+    stats.merge_count = merge_count_.load(memory_order_relaxed);
+    stats.merged_bytes = merged_bytes_.load(memory_order_relaxed);
+    return stats;
+}
+
+void SegmentedIndex::WaitForMerges() const {
+    unique_lock lock(merge_mutex_);
+    idle_cv_.wait(lock, [this] {
+        return !is_merge_requested_ && !is_merging_;
+    });
+}
+
+SegmentedIndex::PreparedQuery SegmentedIndex::PrepareQuery(string_view raw_query, AnalyzedText& storage) const {
+    const QueryWords words = ParseQueryWords(raw_query, stop_words_, analyzer_.get(), &storage);
+
+    vector<PartQuery> parts;
+    for (const auto& segment : segments_) {
+        parts.push_back({segment.get(), {}, {}});
+    }
+    parts.push_back({nullptr, {}, {}});
+    const auto add_ranges = [&](string_view word, double inverse_document_freq, bool is_minus) {
+        const bool is_required = binary_search(words.required_words.begin(), words.required_words.end(), word);
+        for (PartQuery& part : parts) {
+            PostingRange range{nullptr, nullptr, inverse_document_freq, is_required};
+            if (part.segment != nullptr) {
+                const uint32_t term = part.segment->FindTerm(word);
+                if (term == part.segment->GetTermCount()) {
+                    continue;
+                }
+                range.begin = part.segment->postings.data() + part.segment->posting_offsets[term];
+                range.end = part.segment->postings.data() + part.segment->posting_offsets[term + 1];
+            } else {
+                const auto postings = buffer_.postings.find(word);
+                if (postings == buffer_.postings.end()) {
+                    continue;
+                }
+                range.begin = postings->second.data();
+                range.end = postings->second.data() + postings->second.size();
+            }
+            (is_minus ? part.minus_ranges : part.plus_ranges).push_back(range);
+        }
+    };
+    for (const string_view word : words.plus_words) {
+        // Document frequency over live documents of every segment, as if the index were one
+        size_t document_freq = 0;
+        for (const auto& segment : segments_) {
+            const uint32_t term = segment->FindTerm(word);
+            if (term != segment->GetTermCount()) {
+                document_freq += segment->posting_offsets[term + 1] - segment->posting_offsets[term]
+                    - segment->deleted_postings[term];
+            }
+        }
+        if (const auto postings = buffer_.postings.find(word); postings != buffer_.postings.end()) {
+            document_freq += postings->second.size();
+        }
+        if (document_freq > 0) {
+            add_ranges(word, log(live_document_count_ * 1.0 / document_freq), false);
+        } else if (binary_search(words.required_words.begin(), words.required_words.end(), word)) {
+            return {};
+        }
+    }
+    for (const string_view word : words.minus_words) {
+        add_ranges(word, 0.0, true);
+    }
+
+    PreparedQuery query;
+    for (PartQuery& part : parts) {
+        const auto required_count = count_if(part.plus_ranges.begin(), part.plus_ranges.end(), [](const PostingRange& range) {
+            return range.is_required;
+        });
+        // A part lacking one of the required words has no match
+        if (!part.plus_ranges.empty() && static_cast<size_t>(required_count) == words.required_words.size()) {
+            query.parts.push_back(move(part));
+        }
+    }
+    return query;
+}
+
+bool SegmentedIndex::ContainsLiveDocument(int document_id) const {
+    if (buffer_.positions.count(document_id) > 0) {
+        return true;
+    }
+    return any_of(segments_.begin(), segments_.end(), [document_id](const auto& segment) {
+        const auto id = lower_bound(segment->document_ids.begin(), segment->document_ids.end(), document_id);
+        return id != segment->document_ids.end() && *id == document_id
+            && !segment->IsDeleted(static_cast<uint32_t>(id - segment->document_ids.begin()));
+    });
+}
+
+size_t SegmentedIndex::GetTier(size_t live_document_count) const {
+    size_t tier = 0;
+    size_t bound = options_.max_buffered_documents * options_.segments_per_tier;
+    while (live_document_count >= bound) {
+        ++tier;
+        bound *= options_.segments_per_tier;
+    }
+    return tier;
+}
+
+void SegmentedIndex::FlushBuffer() {
+    vector<pair<int, uint32_t>> live_documents;
+    for (uint32_t document = 0; document < buffer_.document_ids.size(); ++document) {
+        if (!buffer_.IsDeleted(document)) {
+            live_documents.emplace_back(buffer_.document_ids[document], document);
+        }
+    }
+    if (!live_documents.empty()) {
+        sort(live_documents.begin(), live_documents.end());
+        vector<uint32_t> remap(buffer_.document_ids.size());
+        vector<int> document_ids;
+        vector<DocumentData> documents;
+        for (const auto& [document_id, document] : live_documents) {
+            remap[document] = static_cast<uint32_t>(document_ids.size());
+            document_ids.push_back(document_id);
+            documents.push_back(buffer_.documents[document]);
+        }
+        SegmentWriter writer(move(document_ids), move(documents));
+        vector<Posting> postings;
+        for (const auto& [word, buffer_postings] : buffer_.postings) {
+            postings.clear();
+            for (const Posting& posting : buffer_postings) {
+                postings.push_back({remap[posting.document], posting.term_freq});
+            }
+            writer.AddTerm(word, postings);
+        }
+        segments_.push_back(writer.Finish());
+    }
+    buffer_ = Buffer{};
+    flush_count_.fetch_add(1, memory_order_relaxed);
+}
+
+void SegmentedIndex::RequestMerge() {
+    {
+        lock_guard lock(merge_mutex_);
+        is_merge_requested_ = true;
+    }
+    merge_cv_.notify_one();
+}
+
+void SegmentedIndex::RunMergeThread() {
+    unique_lock lock(merge_mutex_);
+    for (;;) {
+        merge_cv_.wait(lock, [this] {
+            return is_stopping_ || is_merge_requested_;
+        });
+        if (is_stopping_) {
+            break;
+        }
+        is_merge_requested_ = false;
+        is_merging_ = true;
+        lock.unlock();
+        while (!is_stopping_ && MergeOnce()) {
+        }
+        lock.lock();
+        is_merging_ = false;
+        idle_cv_.notify_all();
+    }
+    is_merge_requested_ = false;
+    idle_cv_.notify_all();
+}
+
+bool SegmentedIndex::MergeOnce() {
+    // The lowest tier holding enough segments is merged whole
+    vector<shared_ptr<Segment>> sources;
+    {
+        shared_lock lock(index_mutex_);
+        map<size_t, vector<shared_ptr<Segment>>> tiers;
+        for (const auto& segment : segments_) {
+            tiers[GetTier(segment->GetLiveDocumentCount())].push_back(segment);
+        }
+        for (auto& [_, tier_segments] : tiers) {
+            if (tier_segments.size() >= options_.segments_per_tier) {
+                sources = move(tier_segments);
+                break;
+            }
+        }
+    }
+    if (sources.empty()) {
+        return false;
+    }
+
+    // Segments are immutable apart from deletions, so they are read without the lock;
+    // documents removed meanwhile are carried over when the result is swapped in
+    vector<tuple<int, size_t, uint32_t>> live_documents;
+    for (size_t source = 0; source < sources.size(); ++source) {
+        for (uint32_t document = 0; document < sources[source]->document_ids.size(); ++document) {
+            if (!sources[source]->IsDeleted(document)) {
+                live_documents.emplace_back(sources[source]->document_ids[document], source, document);
+            }
+        }
+    }
+    sort(live_documents.begin(), live_documents.end());
+    vector<vector<uint32_t>> remaps(sources.size());
+    for (size_t source = 0; source < sources.size(); ++source) {
+        remaps[source].assign(sources[source]->document_ids.size(), UINT32_MAX);
+    }
+    vector<int> document_ids;
+    vector<DocumentData> documents;
+    for (const auto& [document_id, source, document] : live_documents) {
+        remaps[source][document] = static_cast<uint32_t>(document_ids.size());
+        document_ids.push_back(document_id);
+        documents.push_back(sources[source]->documents[document]);
+    }
+
+    SegmentWriter writer(move(document_ids), move(documents));
+    RateLimiter rate_limiter(options_.merge_bytes_per_second);
+    // Waits for the rate limiter unless the index is being destroyed; false abandons the merge
+    const auto pay = [&](size_t bytes) {
+        const auto paid = rate_limiter.Acquire(bytes);
+        unique_lock lock(merge_mutex_);
+        return !merge_cv_.wait_until(lock, paid, [this] {
+            return is_stopping_.load();
+        });
+    };
+    size_t unpaid_bytes = 0;
+    size_t written_bytes = 0;
+    vector<uint32_t> cursors(sources.size(), 0);
+    vector<Posting> postings;
+    for (;;) {
+        if (is_stopping_) {
+            return false;
+        }
+        // Smallest term not yet written, over the sorted term lists of all sources
+        string_view word;
+        bool has_word = false;
+        for (size_t source = 0; source < sources.size(); ++source) {
+            if (cursors[source] < sources[source]->GetTermCount()) {
+                const string_view term = sources[source]->GetTerm(cursors[source]);
+                if (!has_word || term < word) {
+                    word = term;
+                    has_word = true;
+                }
+            }
+        }
+        if (!has_word) {
+            break;
+        }
+        postings.clear();
+        for (size_t source = 0; source < sources.size(); ++source) {
+            const Segment& segment = *sources[source];
+            const uint32_t term = cursors[source];
+            if (term < segment.GetTermCount() && segment.GetTerm(term) == word) {
+                for (uint32_t i = segment.posting_offsets[term]; i < segment.posting_offsets[term + 1]; ++i) {
+                    const uint32_t document = remaps[source][segment.postings[i].document];
+                    if (document != UINT32_MAX) {
+                        postings.push_back({document, segment.postings[i].term_freq});
+                    }
+                }
+                ++cursors[source];
+            }
+        }
+        writer.AddTerm(word, postings);
+        const size_t term_bytes = word.size() + sizeof(uint32_t) * 2 + postings.size() * sizeof(Posting);
+        unpaid_bytes += term_bytes;
+        written_bytes += term_bytes;
+        if (unpaid_bytes >= RATE_LIMIT_CHUNK_SIZE) {
+            if (!pay(unpaid_bytes)) {
+                return false;
+            }
+            unpaid_bytes = 0;
+        }
+    }
+    if (!pay(unpaid_bytes)) {
+        return false;
+    }
+    const shared_ptr<Segment> merged = writer.Finish();
+    const size_t merged_byte_size = merged->GetByteSize();
+    // Finish writes the forward index; charge the part of the segment the terms did not
+    if (!pay(merged_byte_size - min(merged_byte_size, written_bytes))) {
+        return false;
+    }
+    merged_bytes_.fetch_add(merged_byte_size, memory_order_relaxed);
+
+    {
+        unique_lock lock(index_mutex_);
+        for (uint32_t document = 0; document < merged->document_ids.size(); ++document) {
+            const auto& [_, source, source_document] = live_documents[document];
+            if (sources[source]->IsDeleted(source_document)) {
+                merged->MarkDeleted(document);
+            }
+        }
+        segments_.erase(remove_if(segments_.begin(), segments_.end(), [&sources](const auto& segment) {
+            return find(sources.begin(), sources.end(), segment) != sources.end();
+        }), segments_.end());
+        if (merged->GetLiveDocumentCount() > 0) {
+            segments_.push_back(merged);
+        }
+    }
+    merge_count_.fetch_add(1, memory_order_relaxed);
+    return true;
+}
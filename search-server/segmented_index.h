@@ -0,0 +1,285 @@
+#pragma once
+#include "document.h"
+#include "stop_word_set.h"
+#include "text_analysis.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <execution>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct SegmentedIndexOptions {
+    // The in-memory segment is frozen into an immutable one at this many documents
+    size_t max_buffered_documents = 1024;
+    // A tier is merged into one segment once it holds this many segments. A segment
+    // of n live documents is in tier log(n / max_buffered_documents) to this base.
+    size_t segments_per_tier = 8;
+    // Cap on the merge rate in bytes of segment data written per second; 0 is unlimited
+    double merge_bytes_per_second = 0.0;
+};
+
+struct SegmentedIndexStats {
+    size_t segment_count = 0;
+    size_t buffered_documents = 0;
+    // Removed documents still taking space in segments until their next merge
+    size_t deleted_documents = 0;
+    uint64_t flush_count = 0;
+    uint64_t merge_count = 0;
+    uint64_t merged_bytes = 0;
+};
+
+// LSM-style alternative to SearchServer with the same ranking: immutable flat
+// segments plus a small in-memory segment. AddDocument only touches the in-memory
+// segment, so its cost does not grow with the index; full in-memory segments are
+// frozen and merged by a background thread with a tiered policy. Removal marks
+// documents in per-segment bitmaps and merges drop them. IDF is computed from
+// live document frequencies over all segments, so documents get the same relevance
+// as in SearchServer. Results are ordered by IsRankedBefore, which breaks ties by
+// rating and id; SearchServer::FindTopDocuments treats relevances within 1e-6 as
+// equal and does not break ties by id, so the two may differ in the order and, at
+// the cut-off, the choice of such near-ties.
+// All methods are safe to call concurrently.
+class SegmentedIndex {
+public:
+    explicit SegmentedIndex(std::string_view stop_words_text, SegmentedIndexOptions options = {},
+                            std::shared_ptr<const TextAnalyzer> analyzer = nullptr);
+    ~SegmentedIndex();
+
+    SegmentedIndex(const SegmentedIndex&) = delete;
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    // Same query syntax as SearchServer: word, -word and +word
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    // Segments are searched in parallel
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query,
+                                           DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query,
+                                           DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query) const;
+
+    int GetDocumentCount() const;
+    SegmentedIndexStats GetStats() const;
+    // Blocks until the background thread has no merge left to do
+    void WaitForMerges() const;
+
+private:
+    struct DocumentData {
+        int rating;
+        DocumentStatus status;
+    };
+
+    struct Posting {
+        uint32_t document;
+        double term_freq;
+    };
+
+    // Immutable once built, except for the deletion state. Documents are sorted by id
+    // and postings by document, so both are in id order.
+    struct Segment {
+        std::vector<int> document_ids;
+        std::vector<DocumentData> documents;
+        // Term i is term_text[term_offsets[i], term_offsets[i + 1]), terms are sorted
+        std::string term_text;
+        std::vector<uint32_t> term_offsets;
+        // Postings of term i are postings[posting_offsets[i], posting_offsets[i + 1])
+        std::vector<uint32_t> posting_offsets;
+        std::vector<Posting> postings;
+        // Term ids of document d, used to keep document frequencies exact on removal
+        std::vector<uint32_t> document_term_offsets;
+        std::vector<uint32_t> document_terms;
+
+        // Read without the index lock by merges, hence atomic
+        std::unique_ptr<std::atomic<uint64_t>[]> deleted;
+        // Guarded by the index lock
+        std::vector<uint32_t> deleted_postings;
+        size_t deleted_count = 0;
+
+        size_t GetTermCount() const;
+        std::string_view GetTerm(uint32_t term) const;
+        // Term id, or GetTermCount() if absent
+        uint32_t FindTerm(std::string_view word) const;
+        bool IsDeleted(uint32_t document) const;
+        // Requires the exclusive index lock
+        void MarkDeleted(uint32_t document);
+        size_t GetLiveDocumentCount() const;
+        size_t GetByteSize() const;
+    };
+
+    class SegmentWriter;
+
+    // Documents in insertion order; removed ones leave an empty slot and lose their postings
+    struct Buffer {
+        std::vector<int> document_ids;
+        std::vector<DocumentData> documents;
+        std::vector<std::vector<std::string_view>> document_words;
+        std::vector<bool> deleted;
+        std::map<std::string, std::vector<Posting>, std::less<>> postings;
+        std::unordered_map<int, uint32_t> positions;
+        size_t deleted_count = 0;
+
+        bool IsDeleted(uint32_t document) const;
+        size_t GetLiveDocumentCount() const;
+    };
+
+    struct PostingRange {
+        const Posting* begin;
+        const Posting* end;
+        double inverse_document_freq;
+        bool is_required;
+    };
+
+    struct PartQuery {
+        const Segment* segment;
+        std::vector<PostingRange> plus_ranges;
+        std::vector<PostingRange> minus_ranges;
+    };
+
+    struct PreparedQuery {
+        // One entry per segment with matches; the buffer comes last, with segment == nullptr
+        std::vector<PartQuery> parts;
+    };
+
+    const SegmentedIndexOptions options_;
+    const std::shared_ptr<const TextAnalyzer> analyzer_;
+    StopWordSet stop_words_;
+
+    mutable std::shared_mutex index_mutex_;
+    std::vector<std::shared_ptr<Segment>> segments_;
+    Buffer buffer_;
+    size_t live_document_count_ = 0;
+
+    mutable std::mutex merge_mutex_;
+    mutable std::condition_variable merge_cv_;
+    mutable std::condition_variable idle_cv_;
+    bool is_merge_requested_ = false;
+    bool is_merging_ = false;
+    std::atomic<bool> is_stopping_{false};
+    std::atomic<uint64_t> flush_count_{0};
+    std::atomic<uint64_t> merge_count_{0};
+    std::atomic<uint64_t> merged_bytes_{0};
+    std::thread merge_thread_;
+
+    PreparedQuery PrepareQuery(std::string_view raw_query, AnalyzedText& storage) const;
+    bool ContainsLiveDocument(int document_id) const;
+    size_t GetTier(size_t live_document_count) const;
+
+    void FlushBuffer();
+    void RequestMerge();
+    void RunMergeThread();
+    bool MergeOnce();
+
+    template <typename DocumentPredicate>
+    std::vector<Document> ScorePart(const PartQuery& part, DocumentPredicate document_predicate) const;
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsImpl(ExecutionPolicy&& policy, std::string_view raw_query,
+                                               DocumentPredicate document_predicate) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedIndex::ScorePart(const PartQuery& part, DocumentPredicate document_predicate) const {
+    std::vector<PostingRange> plus_ranges = part.plus_ranges;
+    std::vector<PostingRange> minus_ranges = part.minus_ranges;
+    const auto required_count = std::count_if(plus_ranges.begin(), plus_ranges.end(), [](const PostingRange& range) {
+        return range.is_required;
+    });
+    const auto& document_ids = part.segment != nullptr ? part.segment->document_ids : buffer_.document_ids;
+    const auto& documents = part.segment != nullptr ? part.segment->documents : buffer_.documents;
+
+    // Max-heap on rank: the front is the worst document kept so far
+    std::vector<Document> top;
+    top.reserve(MAX_RESULT_DOCUMENT_COUNT + 1);
+    for (;;) {
+        uint32_t document = UINT32_MAX;
+        for (const PostingRange& range : plus_ranges) {
+            if (range.begin != range.end) {
+                document = std::min(document, range.begin->document);
+            }
+        }
+        if (document == UINT32_MAX) {
+            break;
+        }
+        double relevance = 0.0;
+        std::ptrdiff_t required_matches = 0;
+        for (PostingRange& range : plus_ranges) {
+            if (range.begin != range.end && range.begin->document == document) {
+                relevance += range.begin->term_freq * range.inverse_document_freq;
+                required_matches += range.is_required;
+                ++range.begin;
+            }
+        }
+        bool is_excluded = required_matches < required_count
+            || (part.segment != nullptr && part.segment->IsDeleted(document));
+        for (PostingRange& range : minus_ranges) {
+            while (range.begin != range.end && range.begin->document < document) {
+                ++range.begin;
+            }
+            is_excluded = is_excluded || (range.begin != range.end && range.begin->document == document);
+        }
+        const DocumentData& document_data = documents[document];
+        if (is_excluded || !document_predicate(document_ids[document], document_data.status, document_data.rating)) {
+            continue;
+        }
+        top.emplace_back(document_ids[document], relevance, document_data.rating);
+        std::push_heap(top.begin(), top.end(), IsRankedBefore);
+        if (top.size() > static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)) {
+            std::pop_heap(top.begin(), top.end(), IsRankedBefore);
+            top.pop_back();
+        }
+    }
+    return top;
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SegmentedIndex::FindTopDocumentsImpl(ExecutionPolicy&& policy, std::string_view raw_query,
+                                                           DocumentPredicate document_predicate) const {
+    AnalyzedText storage;
+    std::shared_lock lock(index_mutex_);
+    const PreparedQuery query = PrepareQuery(raw_query, storage);
+    // Relevance does not depend on the segment, so the overall top is among the
+    // tops of the segments
+    std::vector<std::vector<Document>> part_tops(query.parts.size());
+    std::transform(policy, query.parts.begin(), query.parts.end(), part_tops.begin(), [&](const PartQuery& part) {
+        return ScorePart(part, document_predicate);
+    });
+    lock.unlock();
+
+    std::vector<Document> matched_documents;
+    for (const auto& part_top : part_tops) {
+        matched_documents.insert(matched_documents.end(), part_top.begin(), part_top.end());
+    }
+    const size_t result_size = std::min(matched_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    std::partial_sort(matched_documents.begin(), matched_documents.begin() + result_size, matched_documents.end(),
+                      IsRankedBefore);
+    matched_documents.resize(result_size);
+    return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedIndex::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocumentsImpl(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedIndex::FindTopDocuments(const std::execution::parallel_policy&, std::string_view raw_query,
+                                                       DocumentPredicate document_predicate) const {
+    return FindTopDocumentsImpl(std::execution::par, raw_query, document_predicate);
+}
@@ -0,0 +1,146 @@
+#include "stop_word_set.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+namespace {
+
+const uint32_t MAX_BUCKET_SEED = 1u << 16;
+
+size_t GetTableSize(size_t min_size) {
+    size_t size = 1;
+    while (size < min_size) {
+        size *= 2;
+    }
+    return size;
+}
+
+} // namespace
+
+StopWordSet::StopWordSet(pmr::memory_resource* resource)
+    : words_(resource)
+    , bucket_seeds_(resource)
+    , slots_(resource) {
+}
+
+StopWordSet::StopWordSet(const vector<string_view>& words, pmr::memory_resource* resource)
+    : StopWordSet(resource) {
+    vector<string_view> unique_words;
+    unique_words.reserve(words.size());
+    for (string_view word : words) {
+        if (!word.empty()) {
+            unique_words.push_back(word);
+        }
+    }
+    sort(unique_words.begin(), unique_words.end());
+    unique_words.erase(unique(unique_words.begin(), unique_words.end()), unique_words.end());
+    if (unique_words.empty()) {
+        return;
+    }
+    // Two distinct words can only be inseparable if their full hashes collide, so a
+    // new hash seed always gets the construction going again
+    while (!TryBuild(unique_words)) {
+        ++hash_seed_;
+    }
+}
+
+StopWordSet::StopWordSet(const StopWordSet& other, pmr::memory_resource* resource)
+    : words_(other.words_, resource)
+    , bucket_seeds_(other.bucket_seeds_, resource)
+    , slots_(other.slots_, resource)
+    , hash_seed_(other.hash_seed_)
+    , word_count_(other.word_count_) {
+}
+
+bool StopWordSet::Contains(string_view word) const {
+    if (word_count_ == 0 || word.empty()) {
+        return false;
+    }
+    const uint64_t word_hash = Hash(word, hash_seed_);
+    const uint32_t bucket_seed = bucket_seeds_[word_hash & (bucket_seeds_.size() - 1)];
+    const Slot& slot = slots_[GetSlot(word_hash, bucket_seed, slots_.size())];
+    return slot.size == word.size() && string_view(words_).substr(slot.offset, slot.size) == word;
+}
+
+size_t StopWordSet::size() const {
+    return word_count_;
+}
+
+uint64_t StopWordSet::Hash(string_view word, uint64_t seed) {
+    // FNV-1a with the seed folded into the offset basis
+    uint64_t word_hash = 0xcbf29ce484222325 ^ (seed * 0x9e3779b97f4a7c15);
+    for (const char c : word) {
+        word_hash ^= static_cast<unsigned char>(c);
+        word_hash *= 0x100000001b3;
+    }
+    return word_hash;
+}
+
+size_t StopWordSet::GetSlot(uint64_t word_hash, uint32_t bucket_seed, size_t slot_count) {
+    uint64_t value = word_hash ^ ((bucket_seed + 1) * 0xbf58476d1ce4e5b9);
+    value ^= value >> 31;
+    value *= 0x94d049bb133111eb;
+    value ^= value >> 29;
+    return value & (slot_count - 1);
+}
+
+bool StopWordSet::TryBuild(const vector<string_view>& words) {
+    const size_t bucket_count = GetTableSize(words.size());
+    const size_t slot_count = GetTableSize(2 * words.size());
+    vector<uint64_t> hashes(words.size());
+    vector<vector<size_t>> buckets(bucket_count);
+    for (size_t i = 0; i < words.size(); ++i) {
+        hashes[i] = Hash(words[i], hash_seed_);
+        buckets[hashes[i] & (bucket_count - 1)].push_back(i);
+    }
+    // Crowded buckets are placed first, while most slots are still free
+    vector<size_t> order(bucket_count);
+    iota(order.begin(), order.end(), size_t{0});
+    stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    vector<uint32_t> bucket_seeds(bucket_count, 0);
+    vector<size_t> word_slots(words.size());
+    vector<bool> is_taken(slot_count, false);
+    vector<size_t> candidate_slots;
+    for (const size_t bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        bool is_placed = false;
+        for (uint32_t seed = 0; seed < MAX_BUCKET_SEED && !is_placed; ++seed) {
+            candidate_slots.clear();
+            for (const size_t word : buckets[bucket]) {
+                const size_t slot = GetSlot(hashes[word], seed, slot_count);
+                if (is_taken[slot] || find(candidate_slots.begin(), candidate_slots.end(), slot) != candidate_slots.end()) {
+                    break;
+                }
+                candidate_slots.push_back(slot);
+            }
+            if (candidate_slots.size() == buckets[bucket].size()) {
+                bucket_seeds[bucket] = seed;
+                for (size_t i = 0; i < candidate_slots.size(); ++i) {
+                    is_taken[candidate_slots[i]] = true;
+                    word_slots[buckets[bucket][i]] = candidate_slots[i];
+                }
+                is_placed = true;
+            }
+        }
+        if (!is_placed) {
+            return false;
+        }
+    }
+
+    words_.clear();
+    slots_.assign(slot_count, Slot{});
+    for (size_t i = 0; i < words.size(); ++i) {
+        slots_[word_slots[i]] = {static_cast<uint32_t>(words_.size()), static_cast<uint32_t>(words[i].size())};
+        words_.append(words[i]);
+    }
+    bucket_seeds_.assign(bucket_seeds.begin(), bucket_seeds.end());
+    word_count_ = words.size();
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of words with a perfect hash built once at construction
+// (hash and displace): a word is hashed once, its bucket picks the seed that maps
+// it to a slot, and a lookup ends with at most one comparison. Nothing is allocated
+// on lookup.
+class StopWordSet {
+public:
+    explicit StopWordSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    // Empty words and duplicates are ignored
+    StopWordSet(const std::vector<std::string_view>& words,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    StopWordSet(const StopWordSet& other, std::pmr::memory_resource* resource);
+
+    bool Contains(std::string_view word) const;
+    size_t size() const;
+
+private:
+    // size == 0 marks an empty slot
+    struct Slot {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    std::pmr::string words_;
+    std::pmr::vector<uint32_t> bucket_seeds_;
+    std::pmr::vector<Slot> slots_;
+    uint64_t hash_seed_ = 0;
+    size_t word_count_ = 0;
+
+    static uint64_t Hash(std::string_view word, uint64_t seed);
+    static size_t GetSlot(uint64_t word_hash, uint32_t bucket_seed, size_t slot_count);
+    bool TryBuild(const std::vector<std::string_view>& words);
+};
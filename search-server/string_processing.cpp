@@ -1,4 +1,5 @@
 #include "string_processing.h"
+#include <algorithm>
 using namespace std;
     
 vector<string_view> SplitIntoWords(string_view str) {
@@ -18,4 +19,10 @@ vector<string_view> SplitIntoWords(string_view str) {
     }
 
     return result;
-} 
+}
+
+bool IsValidWord(string_view word) {
+    return none_of(word.begin(), word.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+    });
+}
@@ -7,6 +7,8 @@ template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings);
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
+// A word is invalid if it contains control characters
+bool IsValidWord(std::string_view word);
 
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
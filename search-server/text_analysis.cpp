@@ -0,0 +1,210 @@
+#include "text_analysis.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+const size_t MIN_STEM_LENGTH = 3;
+
+// Same number of bytes as the code point was decoded from; only called for
+// code points whose lower-case form has the same UTF-8 length
+void EncodeUtf8(char32_t code_point, char* out, size_t length) {
+    if (length == 2) {
+        out[0] = static_cast<char>(0xC0 | (code_point >> 6));
+        out[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (length == 3) {
+        out[0] = static_cast<char>(0xE0 | (code_point >> 12));
+        out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+char32_t FoldCase(char32_t c) {
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) {
+        return c + 0x20;
+    }
+    if ((c >= 0x100 && c <= 0x137) || (c >= 0x14A && c <= 0x177)) {
+        return c | 1;
+    }
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) {
+        return c % 2 == 1 ? c + 1 : c;
+    }
+    if (c == 0x178) {
+        return 0xFF;
+    }
+    if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) {
+        return c + 0x20;
+    }
+    if (c >= 0x400 && c <= 0x40F) {
+        return c + 0x50;
+    }
+    if (c >= 0x410 && c <= 0x42F) {
+        return c + 0x20;
+    }
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF)) {
+        return c | 1;
+    }
+    return c;
+}
+
+size_t CountCodePoints(string_view text) {
+    return count_if(text.begin(), text.end(), [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    });
+}
+
+bool IsCyrillic(string_view term) {
+    return term.size() >= 2 && (term[term.size() - 2] == '\xD0' || term[term.size() - 2] == '\xD1');
+}
+
+// Strips the first matching ending that leaves a long enough stem; endings are
+// ordered so that longer ones are tried first
+template <size_t N>
+bool StripEnding(string& term, const string_view (&endings)[N], string_view replacement = {}) {
+    for (const string_view ending : endings) {
+        if (term.size() > ending.size()
+            && string_view(term).substr(term.size() - ending.size()) == ending
+            && CountCodePoints(string_view(term).substr(0, term.size() - ending.size())) >= MIN_STEM_LENGTH) {
+            term.replace(term.size() - ending.size(), ending.size(), replacement);
+            return true;
+        }
+    }
+    return false;
+}
+
+void StemRussian(string& term) {
+    // ё -> е
+    for (size_t pos = 0; (pos = term.find("\xD1\x91", pos)) != string::npos; pos += 2) {
+        term[pos] = '\xD0';
+        term[pos + 1] = '\xB5';
+    }
+    static const string_view endings[] = {
+        "ями", "ами", "ого", "его", "ому", "ему", "ыми", "ими", "ать", "ять", "ить", "ешь", "ете", "ишь", "ите",
+        "ая", "яя", "ое", "ее", "ые", "ие", "ый", "ий", "ой", "ом", "ем", "ам", "ям", "ах", "ях", "ию", "ья",
+        "ью", "ов", "ев", "ей", "ют", "ут", "ит", "ет",
+        "а", "я", "о", "е", "ы", "и", "у", "ю", "ь", "й",
+    };
+    StripEnding(term, endings);
+}
+
+void StemEnglish(string& term) {
+    static const string_view plural_endings[] = {"sses"};
+    static const string_view y_endings[] = {"ies"};
+    static const string_view endings[] = {"ing", "ed", "ly"};
+    if (StripEnding(term, plural_endings, "ss") || StripEnding(term, y_endings, "y")) {
+        return;
+    }
+    if (StripEnding(term, endings)) {
+        // running -> runn -> run
+        const size_t size = term.size();
+        if (size > MIN_STEM_LENGTH && term[size - 1] == term[size - 2]
+            && string_view("aeiouylsz").find(term[size - 1]) == string_view::npos) {
+            term.pop_back();
+        }
+        return;
+    }
+    const string_view word = term;
+    if (word.size() > MIN_STEM_LENGTH && word.back() == 's' && word[word.size() - 2] != 's'
+        && word[word.size() - 2] != 'u' && word[word.size() - 2] != 'i') {
+        term.pop_back();
+    }
+}
+
+} // namespace
+
+void AnalyzedText::Append(string_view term) {
+    buffer_.append(term);
+    ends_.push_back(buffer_.size());
+}
+
+void AnalyzedText::Clear() {
+    buffer_.clear();
+    ends_.clear();
+}
+
+size_t AnalyzedText::size() const {
+    return ends_.size();
+}
+
+string_view AnalyzedText::operator[](size_t index) const {
+    const size_t begin = index == 0 ? 0 : ends_[index - 1];
+    return string_view(buffer_).substr(begin, ends_[index] - begin);
+}
+
+void CaseFoldFilter::operator()(string& term) const {
+    for (size_t pos = 0; pos < term.size();) {
+        if (static_cast<unsigned char>(term[pos]) < 0x80) {
+            if (term[pos] >= 'A' && term[pos] <= 'Z') {
+                term[pos] += 'a' - 'A';
+            }
+            ++pos;
+            continue;
+        }
+        const auto [code_point, length] = detail::DecodeUtf8(term, pos);
+        const char32_t folded = FoldCase(code_point);
+        if (folded != code_point) {
+            EncodeUtf8(folded, &term[pos], length);
+        }
+        pos += length;
+    }
+}
+
+void LightStemFilter::operator()(string& term) const {
+    if (IsCyrillic(term)) {
+        StemRussian(term);
+    } else if (all_of(term.begin(), term.end(), [](char c) { return c >= 'a' && c <= 'z'; })) {
+        StemEnglish(term);
+    }
+}
+
+namespace detail {
+
+pair<char32_t, size_t> DecodeUtf8(string_view text, size_t pos) {
+    const auto byte = [&](size_t index) {
+        return static_cast<unsigned char>(text[index]);
+    };
+    const unsigned char lead = byte(pos);
+    size_t length = 0;
+    char32_t code_point = 0;
+    if (lead < 0x80) {
+        return {lead, 1};
+    } else if ((lead & 0xE0) == 0xC0) {
+        length = 2;
+        code_point = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        code_point = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4;
+        code_point = lead & 0x07;
+    } else {
+        return {0xFFFD, 1};
+    }
+    if (pos + length > text.size()) {
+        return {0xFFFD, 1};
+    }
+    for (size_t i = 1; i < length; ++i) {
+        if ((byte(pos + i) & 0xC0) != 0x80) {
+            return {0xFFFD, 1};
+        }
+        code_point = (code_point << 6) | (byte(pos + i) & 0x3F);
+    }
+    // Overlong encodings would let two spellings of one word produce different terms
+    static const char32_t min_code_points[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (code_point < min_code_points[length] || code_point > 0x10FFFF) {
+        return {0xFFFD, 1};
+    }
+    return {code_point, length};
+}
+
+bool IsWordCodePoint(char32_t c) {
+    if (c < 0x80) {
+        return IsAsciiWordChar(static_cast<char>(c));
+    }
+    return !((c >= 0x80 && c <= 0xBF) || c == 0xD7 || c == 0xF7
+             || (c >= 0x2000 && c <= 0x206F) || (c >= 0x3000 && c <= 0x303F) || (c >= 0xFF00 && c <= 0xFF0F));
+}
+
+} // namespace detail
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Terms produced from one text, stored back to back in a single buffer. Views
+// returned by operator[] stay valid until the next Append or Clear.
+class AnalyzedText {
+public:
+    void Append(std::string_view term);
+    void Clear();
+
+    size_t size() const;
+    std::string_view operator[](size_t index) const;
+
+private:
+    std::string buffer_;
+    std::vector<size_t> ends_;
+};
+
+// Turns text into index terms. SearchServer applies the same analyzer to documents,
+// stop words and query words, so they always agree.
+class TextAnalyzer {
+public:
+    virtual ~TextAnalyzer() = default;
+    // Appends the terms of text to terms
+    virtual void Analyze(std::string_view text, AnalyzedText& terms) const = 0;
+};
+
+// A tokenizer followed by filters, composed at compile time: the only indirect
+// call is Analyze itself, once per text. A tokenizer provides
+//   template <typename Callback> void ForEachToken(std::string_view text, Callback&& callback) const;
+// and a filter provides void operator()(std::string& term) const. A term left
+// empty by a filter is dropped.
+template <typename Tokenizer, typename... Filters>
+class AnalyzerChain final : public TextAnalyzer {
+public:
+    AnalyzerChain() = default;
+    explicit AnalyzerChain(Tokenizer tokenizer, Filters... filters)
+        : tokenizer_(std::move(tokenizer))
+        , filters_(std::move(filters)...) {
+    }
+
+    void Analyze(std::string_view text, AnalyzedText& terms) const override {
+        if constexpr (sizeof...(Filters) == 0) {
+            tokenizer_.ForEachToken(text, [&terms](std::string_view token) {
+                terms.Append(token);
+            });
+        } else {
+            std::string term;
+            tokenizer_.ForEachToken(text, [&](std::string_view token) {
+                term.assign(token);
+                std::apply([&term](const Filters&... filters) {
+                    ((term.empty() ? void() : filters(term)), ...);
+                }, filters_);
+                if (!term.empty()) {
+                    terms.Append(term);
+                }
+            });
+        }
+    }
+
+private:
+    Tokenizer tokenizer_;
+    std::tuple<Filters...> filters_;
+};
+
+// Splits on ASCII spaces only, exactly like SplitIntoWords
+struct WhitespaceTokenizer {
+    template <typename Callback>
+    void ForEachToken(std::string_view text, Callback&& callback) const;
+};
+
+// Words are maximal runs of letters and digits in UTF-8 text; ASCII punctuation,
+// Latin-1 and general punctuation are separators. Malformed bytes are kept as part
+// of a word rather than dropped.
+struct Utf8Tokenizer {
+    template <typename Callback>
+    void ForEachToken(std::string_view text, Callback&& callback) const;
+};
+
+// Lower-cases ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic letters
+struct CaseFoldFilter {
+    void operator()(std::string& term) const;
+};
+
+// Strips common inflectional endings of Russian and English words, keeping a stem
+// of at least three letters. Russian ё is folded into е. Expects lower-case input.
+struct LightStemFilter {
+    void operator()(std::string& term) const;
+};
+
+using MultilingualAnalyzer = AnalyzerChain<Utf8Tokenizer, CaseFoldFilter, LightStemFilter>;
+
+namespace detail {
+
+// Decodes the code point starting at text[pos]; a malformed sequence decodes as
+// U+FFFD of length 1
+std::pair<char32_t, size_t> DecodeUtf8(std::string_view text, size_t pos);
+bool IsWordCodePoint(char32_t code_point);
+
+inline bool IsAsciiWordChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+} // namespace detail
+
+template <typename Callback>
+void WhitespaceTokenizer::ForEachToken(std::string_view text, Callback&& callback) const {
+    size_t pos = text.find_first_not_of(' ');
+    while (pos != std::string_view::npos) {
+        const size_t space = text.find(' ', pos);
+        callback(text.substr(pos, space == std::string_view::npos ? std::string_view::npos : space - pos));
+        pos = text.find_first_not_of(' ', space);
+    }
+}
+
+template <typename Callback>
+void Utf8Tokenizer::ForEachToken(std::string_view text, Callback&& callback) const {
+    size_t word_begin = std::string_view::npos;
+    for (size_t pos = 0; pos < text.size();) {
+        bool is_word_char;
+        size_t length = 1;
+        if (static_cast<unsigned char>(text[pos]) < 0x80) {
+            is_word_char = detail::IsAsciiWordChar(text[pos]);
+        } else {
+            const auto [code_point, code_point_length] = detail::DecodeUtf8(text, pos);
+            is_word_char = detail::IsWordCodePoint(code_point);
+            length = code_point_length;
+        }
+        if (is_word_char && word_begin == std::string_view::npos) {
+            word_begin = pos;
+        } else if (!is_word_char && word_begin != std::string_view::npos) {
+            callback(text.substr(word_begin, pos - word_begin));
+            word_begin = std::string_view::npos;
+        }
+        pos += length;
+    }
+    if (word_begin != std::string_view::npos) {
+        callback(text.substr(word_begin));
+    }
+}